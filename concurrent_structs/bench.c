@@ -0,0 +1,512 @@
+// Main File - bench.c
+// Ishika Pol - CSE130
+// Benchmark harness for queue_t, rwlock_t and pool_t. Sweeps producer/consumer counts and queue
+// sizes for the queue, thread counts, write ratios, priorities and modes for the rwlock, and
+// thread counts for a fan-out of short tasks run by the work-stealing pool and by threads
+// sharing one queue_t, and prints one CSV row per configuration with throughput, latency
+// percentiles and fairness.
+// Fairness compares threads doing the same job (producers with producers, consumers with
+// consumers); for the queue, the less even of the two groups is reported.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "futex.h"
+#include "histogram.h"
+#include "pool.h"
+#include "queue.h"
+#include "rwlock.h"
+
+#define DEFAULT_DURATION_MS 200
+#define DEFAULT_MAX_THREADS 8
+// How long a queue thread waits before checking whether the run is over
+#define POLL_NS 10000000
+// n for N_WAY priority in the rwlock sweep
+#define NWAY_N 4
+
+// A fan-out is a binary tree of tasks FANOUT_DEPTH deep: each task does TASK_SPINS loop
+// iterations of work (well under a microsecond) and then spawns its two children
+#define FANOUT_DEPTH 12
+#define FANOUT_TASKS ((1 << (FANOUT_DEPTH + 1)) - 1)
+#define TASK_SPINS 100
+
+// The configurations swept
+static const int queue_threads[] = { 1, 2, 4 };
+// Powers of two, which queue_new() doesn't round up, so the queue_size column is the capacity
+static const int queue_sizes[] = { 2, 64, 1024 };
+static const int write_permilles[] = { 0, 10, 100, 500 };
+static const char *priority_names[] = { "READERS", "WRITERS", "N_WAY" };
+static const char *mode_names[] = { "default", "big_reader" };
+
+#define COUNT(a) ((int) (sizeof(a) / sizeof((a)[0])))
+
+// Everything the benchmark threads of one run share
+typedef struct bench {
+    queue_t *q;
+    rwlock_t *rw;
+    int write_permille;
+    _Atomic bool start;
+    _Atomic bool stop;
+    _Atomic uint64_t data[8]; // What the rwlock critical sections read and write
+    pool_t *pool; // The pool running a fan-out
+    struct worker *workers; // Where fan-out tasks count which thread ran them
+    _Atomic int next_worker; // Next of those a pool thread claims
+    _Atomic int64_t pending; // Tasks of the current queue fan-out not yet finished
+    _Atomic uint32_t done_seq; // Bumped when the last of them finishes
+} bench_t;
+
+// Per-thread results
+typedef struct worker {
+    bench_t *bench;
+    pthread_t thread;
+    uint32_t seed;
+    int group; // Threads are only compared for fairness within their group
+    uint64_t ops;
+    uint64_t hist[BUCKETS]; // Operation latencies
+} worker_t;
+
+// One row of output
+typedef struct result {
+    uint64_t ops;
+    double ops_per_sec;
+    uint64_t p50_ns, p99_ns, p999_ns;
+    uint64_t min_thread_ops, max_thread_ops; // Within the least even group
+    double fairness; // Jain's index over the per-thread op counts: 1 is perfectly even
+} result_t;
+
+// Fairness of one group of threads
+void group_fairness(worker_t *workers, int threads, int group, result_t *r) {
+    uint64_t min = UINT64_MAX, max = 0;
+    double sum = 0, sum_squares = 0;
+    int n = 0;
+
+    for (int i = 0; i < threads; i++) {
+        if (workers[i].group != group) {
+            continue;
+        }
+        uint64_t ops = workers[i].ops;
+        min = ops < min ? ops : min;
+        max = ops > max ? ops : max;
+        sum += ops;
+        sum_squares += (double) ops * ops;
+        n++;
+    }
+    if (n == 0) {
+        return;
+    }
+
+    double fairness = sum_squares > 0 ? sum * sum / (n * sum_squares) : 1;
+    if (r->max_thread_ops == 0 || fairness < r->fairness) {
+        r->fairness = fairness;
+        r->min_thread_ops = min;
+        r->max_thread_ops = max;
+    }
+}
+
+// Record one operation that started at start
+void record(worker_t *w, uint64_t start) {
+    w->hist[bucket_of(monotonic_ns() - start)]++;
+    w->ops++;
+}
+
+// Wait for the start signal
+void wait_start(bench_t *b) {
+    while (!atomic_load_explicit(&(b->start), memory_order_acquire)) {
+    }
+}
+
+// Absolute deadline POLL_NS from now
+void poll_deadline(struct timespec *deadline) {
+    uint64_t ns = monotonic_ns() + POLL_NS;
+
+    deadline->tv_sec = ns / 1000000000;
+    deadline->tv_nsec = ns % 1000000000;
+}
+
+// Queue producer: push until told to stop. Blocked pushes give up every POLL_NS to check,
+// then retry; a push is timed from its first attempt, so a long block is recorded whole.
+void *producer_thread(void *arg) {
+    worker_t *w = (worker_t *) arg;
+    bench_t *b = w->bench;
+    struct timespec deadline;
+    uint64_t start = 0;
+
+    wait_start(b);
+    poll_deadline(&deadline);
+    while (!atomic_load_explicit(&(b->stop), memory_order_relaxed)) {
+        if (start == 0) {
+            start = monotonic_ns();
+        }
+        if (queue_timed_push(b->q, w, &deadline)) {
+            record(w, start);
+            start = 0;
+        } else {
+            poll_deadline(&deadline);
+        }
+    }
+    return NULL;
+}
+
+// Queue consumer: pop until told to stop, timing each pop across its retries like a push
+void *consumer_thread(void *arg) {
+    worker_t *w = (worker_t *) arg;
+    bench_t *b = w->bench;
+    struct timespec deadline;
+    uint64_t start = 0;
+    void *elem;
+
+    wait_start(b);
+    poll_deadline(&deadline);
+    while (!atomic_load_explicit(&(b->stop), memory_order_relaxed)) {
+        if (start == 0) {
+            start = monotonic_ns();
+        }
+        if (queue_timed_pop(b->q, &elem, &deadline)) {
+            record(w, start);
+            start = 0;
+        } else {
+            poll_deadline(&deadline);
+        }
+    }
+    return NULL;
+}
+
+// rwlock thread: read or write, at the configured ratio, until told to stop
+void *rwlock_thread(void *arg) {
+    worker_t *w = (worker_t *) arg;
+    bench_t *b = w->bench;
+    volatile uint64_t sink = 0;
+
+    wait_start(b);
+    while (!atomic_load_explicit(&(b->stop), memory_order_relaxed)) {
+        w->seed = w->seed * 1103515245 + 12345;
+        uint64_t start = monotonic_ns();
+        if ((int) ((w->seed >> 16) % 1000) < b->write_permille) {
+            writer_lock(b->rw);
+            for (int i = 0; i < 8; i++) {
+                uint64_t value = atomic_load_explicit(&(b->data[i]), memory_order_relaxed);
+                atomic_store_explicit(&(b->data[i]), value + 1, memory_order_relaxed);
+            }
+            writer_unlock(b->rw);
+        } else {
+            reader_lock(b->rw);
+            for (int i = 0; i < 8; i++) {
+                sink += atomic_load_explicit(&(b->data[i]), memory_order_relaxed);
+            }
+            reader_unlock(b->rw);
+        }
+        record(w, start);
+    }
+    (void) sink;
+    return NULL;
+}
+
+// Walk a merged histogram of count samples to the 50th, 99th and 99.9th percentiles
+void percentiles(const uint64_t *hist, uint64_t count, result_t *r) {
+    uint64_t seen = 0;
+    uint64_t *targets[] = { &r->p50_ns, &r->p99_ns, &r->p999_ns };
+    uint64_t permilles[] = { 500, 990, 999 };
+    int next = 0;
+
+    for (int j = 0; j < BUCKETS && next < 3; j++) {
+        seen += hist[j];
+        while (next < 3 && count > 0 && seen * 1000 >= permilles[next] * count) {
+            *targets[next++] = bucket_limit(j);
+        }
+    }
+}
+
+// The short piece of work every fan-out task does
+void task_work(void) {
+    volatile uint64_t sink = 0;
+
+    for (int i = 0; i < TASK_SPINS; i++) {
+        sink += i;
+    }
+}
+
+// The run a pool task belongs to; pool tasks only get their depth as an argument
+static bench_t *pool_bench = NULL;
+// The worker_t counting the tasks this pool thread runs, claimed on its first task
+static _Thread_local struct worker *task_worker = NULL;
+
+// Pool fan-out task: work, then submit both children to this thread's own deque
+void pool_task(void *arg) {
+    int depth = (int) (intptr_t) arg;
+    bench_t *b = pool_bench;
+
+    if (task_worker == NULL) {
+        task_worker = &(b->workers[atomic_fetch_add(&(b->next_worker), 1)]);
+    }
+    task_work();
+    task_worker->ops++;
+    if (depth > 0) {
+        pool_submit(b->pool, pool_task, (void *) (intptr_t) (depth - 1));
+        pool_submit(b->pool, pool_task, (void *) (intptr_t) (depth - 1));
+    }
+}
+
+// Shared-queue fan-out thread: pop a task, work, push both children back onto the one
+// queue_t every thread uses. Tasks are queued as depth + 1, so none is NULL.
+void *fanout_thread(void *arg) {
+    worker_t *w = (worker_t *) arg;
+    bench_t *b = w->bench;
+    struct timespec deadline;
+    void *elem;
+
+    wait_start(b);
+    poll_deadline(&deadline);
+    while (!atomic_load_explicit(&(b->stop), memory_order_relaxed)) {
+        if (!queue_timed_pop(b->q, &elem, &deadline)) {
+            poll_deadline(&deadline);
+            continue;
+        }
+        int depth = (int) (intptr_t) elem - 1;
+        task_work();
+        w->ops++;
+        if (depth > 0) {
+            queue_push(b->q, (void *) (intptr_t) depth);
+            queue_push(b->q, (void *) (intptr_t) depth);
+        }
+        if (atomic_fetch_sub_explicit(&(b->pending), 1, memory_order_acq_rel) == 1) {
+            atomic_fetch_add_explicit(&(b->done_seq), 1, memory_order_release);
+            futex_wake(&(b->done_seq), 1);
+        }
+    }
+    return NULL;
+}
+
+// Start the workers, let them run for duration_ms, stop them and summarize their results
+result_t run(bench_t *b, worker_t *workers, int threads, int duration_ms) {
+    result_t r = { 0 };
+    uint64_t hist[BUCKETS] = { 0 };
+
+    uint64_t start = monotonic_ns();
+    atomic_store_explicit(&(b->start), true, memory_order_release);
+    usleep(duration_ms * 1000);
+    atomic_store_explicit(&(b->stop), true, memory_order_relaxed);
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    uint64_t elapsed = monotonic_ns() - start;
+
+    for (int i = 0; i < threads; i++) {
+        r.ops += workers[i].ops;
+        for (int j = 0; j < BUCKETS; j++) {
+            hist[j] += workers[i].hist[j];
+        }
+    }
+    r.ops_per_sec = r.ops / (elapsed / 1e9);
+    group_fairness(workers, threads, 0, &r);
+    group_fairness(workers, threads, 1, &r);
+    percentiles(hist, r.ops, &r);
+    return r;
+}
+
+// Allocate and seed the workers of a run
+worker_t *workers_new(bench_t *b, int threads) {
+    worker_t *workers = calloc(threads, sizeof(worker_t));
+    if (workers == NULL) {
+        fprintf(stderr, "Failed to allocate benchmark threads\n");
+        exit(1);
+    }
+    for (int i = 0; i < threads; i++) {
+        workers[i].bench = b;
+        workers[i].seed = 2654435761u * (i + 1);
+    }
+    return workers;
+}
+
+void print_row(const char *structure, const char *impl, const char *priority, int nway_n,
+    int threads, int producers, int consumers, int size, int write_permille, result_t *r) {
+    printf("%s,%s,%s,%d,%d,%d,%d,%d,%d,%lu,%.0f,%lu,%lu,%lu,%lu,%lu,%.4f\n", structure, impl,
+        priority, nway_n, threads, producers, consumers, size, write_permille,
+        (unsigned long) r->ops,
+        r->ops_per_sec, (unsigned long) r->p50_ns, (unsigned long) r->p99_ns,
+        (unsigned long) r->p999_ns, (unsigned long) r->min_thread_ops,
+        (unsigned long) r->max_thread_ops, r->fairness);
+    fflush(stdout);
+}
+
+// One queue configuration: producers push and consumers pop, each op timed separately
+void bench_queue(int producers, int consumers, int size, int duration_ms) {
+    bench_t b = { 0 };
+    int threads = producers + consumers;
+    worker_t *workers = workers_new(&b, threads);
+
+    b.q = queue_new(size);
+    for (int i = 0; i < threads; i++) {
+        workers[i].group = i < producers ? 0 : 1;
+        pthread_create(&(workers[i].thread), NULL,
+            i < producers ? producer_thread : consumer_thread, &workers[i]);
+    }
+
+    result_t r = run(&b, workers, threads, duration_ms);
+    print_row("queue", "mpmc", "", 0, threads, producers, consumers, size, 0, &r);
+
+    queue_delete(&(b.q));
+    free(workers);
+}
+
+// One fan-out configuration: run whole fan-outs back to back for duration_ms, on the pool or on
+// threads sharing a queue_t. Ops are tasks; the latency percentiles are of whole fan-outs.
+void bench_fanout(bool use_pool, int threads, int duration_ms) {
+    bench_t b = { 0 };
+    worker_t *workers = workers_new(&b, threads);
+    uint64_t hist[BUCKETS] = { 0 }, fanouts = 0;
+    // Big enough for every task of a fan-out, so pushing children never blocks
+    int size = FANOUT_TASKS + 1;
+    result_t r = { 0 };
+
+    b.workers = workers;
+    if (use_pool) {
+        pool_bench = &b;
+        b.pool = pool_new(threads);
+    } else {
+        b.q = queue_new(size);
+        for (int i = 0; i < threads; i++) {
+            pthread_create(&(workers[i].thread), NULL, fanout_thread, &workers[i]);
+        }
+    }
+    atomic_store_explicit(&(b.start), true, memory_order_release);
+
+    uint64_t start = monotonic_ns(), end = start + (uint64_t) duration_ms * 1000000;
+    do {
+        uint64_t fanout_start = monotonic_ns();
+        if (use_pool) {
+            pool_submit(b.pool, pool_task, (void *) (intptr_t) FANOUT_DEPTH);
+            pool_wait(b.pool);
+        } else {
+            // Read the sequence before any task can finish
+            uint32_t seq = atomic_load_explicit(&(b.done_seq), memory_order_acquire);
+            atomic_store_explicit(&(b.pending), FANOUT_TASKS, memory_order_relaxed);
+            queue_push(b.q, (void *) (intptr_t) (FANOUT_DEPTH + 1));
+            while (atomic_load_explicit(&(b.done_seq), memory_order_acquire) == seq) {
+                futex_wait(&(b.done_seq), seq, NULL);
+            }
+        }
+        hist[bucket_of(monotonic_ns() - fanout_start)]++;
+        fanouts++;
+    } while (monotonic_ns() < end);
+    uint64_t elapsed = monotonic_ns() - start;
+
+    if (use_pool) {
+        pool_delete(&(b.pool));
+    } else {
+        atomic_store_explicit(&(b.stop), true, memory_order_relaxed);
+        for (int i = 0; i < threads; i++) {
+            pthread_join(workers[i].thread, NULL);
+        }
+        queue_delete(&(b.q));
+    }
+
+    for (int i = 0; i < threads; i++) {
+        r.ops += workers[i].ops;
+    }
+    r.ops_per_sec = r.ops / (elapsed / 1e9);
+    group_fairness(workers, threads, 0, &r);
+    percentiles(hist, fanouts, &r);
+    print_row(
+        "tasks", use_pool ? "pool" : "queue", "", 0, threads, 0, 0, use_pool ? 0 : size, 0, &r);
+
+    free(workers);
+}
+
+// One rwlock configuration
+void bench_rwlock(PRIORITY priority, RWLOCK_MODE mode, int threads, int write_permille,
+    int duration_ms) {
+    bench_t b = { 0 };
+    worker_t *workers = workers_new(&b, threads);
+
+    b.rw = rwlock_new_mode(priority, NWAY_N, mode);
+    b.write_permille = write_permille;
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&(workers[i].thread), NULL, rwlock_thread, &workers[i]);
+    }
+
+    result_t r = run(&b, workers, threads, duration_ms);
+    // n only applies under N_WAY
+    print_row("rwlock", mode_names[mode], priority_names[priority],
+        priority == N_WAY ? NWAY_N : 0, threads, 0, 0, 0, write_permille, &r);
+
+    rwlock_delete(&(b.rw));
+    free(workers);
+}
+
+int main(int argc, char **argv) {
+    int duration_ms = DEFAULT_DURATION_MS, max_threads = DEFAULT_MAX_THREADS, opt;
+    bool run_queue = false, run_rwlock = false, run_tasks = false;
+
+    while ((opt = getopt(argc, argv, "d:pqrt:")) != -1) {
+        switch (opt) {
+        case 'd': duration_ms = atoi(optarg); break;
+        case 'p': run_tasks = true; break;
+        case 'q': run_queue = true; break;
+        case 'r': run_rwlock = true; break;
+        case 't': max_threads = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-d ms] [-p] [-q] [-r] [-t max_threads]\n", argv[0]);
+            exit(1);
+        }
+    }
+    // With none of -p, -q and -r every sweep runs
+    if (!run_queue && !run_rwlock && !run_tasks) {
+        run_queue = run_rwlock = run_tasks = true;
+    }
+    if (duration_ms < 1 || max_threads < 1) {
+        fprintf(stderr, "Invalid arguments\n");
+        exit(1);
+    }
+
+    printf("structure,impl,priority,nway_n,threads,producers,consumers,queue_size,write_permille,"
+           "ops,ops_per_sec,p50_ns,p99_ns,p999_ns,min_thread_ops,max_thread_ops,fairness\n");
+
+    if (run_queue) {
+        for (int p = 0; p < COUNT(queue_threads); p++) {
+            for (int c = 0; c < COUNT(queue_threads); c++) {
+                if (queue_threads[p] + queue_threads[c] > max_threads) {
+                    continue;
+                }
+                for (int s = 0; s < COUNT(queue_sizes); s++) {
+                    bench_queue(queue_threads[p], queue_threads[c], queue_sizes[s], duration_ms);
+                }
+            }
+        }
+    }
+
+    if (run_rwlock) {
+        for (int priority = READERS; priority <= N_WAY; priority++) {
+            for (int mode = RWLOCK_DEFAULT; mode <= RWLOCK_BIG_READER; mode++) {
+                // Double the thread count up to the maximum, always including the maximum
+                int threads = 1;
+                for (;;) {
+                    for (int w = 0; w < COUNT(write_permilles); w++) {
+                        bench_rwlock((PRIORITY) priority, (RWLOCK_MODE) mode, threads,
+                            write_permilles[w], duration_ms);
+                    }
+                    if (threads == max_threads) {
+                        break;
+                    }
+                    threads = threads * 2 > max_threads ? max_threads : threads * 2;
+                }
+            }
+        }
+    }
+
+    if (run_tasks) {
+        for (int threads = 1;; threads = threads * 2 > max_threads ? max_threads : threads * 2) {
+            bench_fanout(true, threads, duration_ms);
+            bench_fanout(false, threads, duration_ms);
+            if (threads == max_threads) {
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
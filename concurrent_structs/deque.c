@@ -0,0 +1,179 @@
+// Main File - deque.c
+// Ishika Pol - CSE130
+// Implementation of a growable Chase-Lev work-stealing deque with C11 atomics.
+
+// Citation: Le, Pop, Cohen, Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak
+// Memory Models" (PPoPP 2013)
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "deque.h"
+
+#define CACHE_LINE_SIZE 64
+
+// A circular array of elements. When the deque grows, the old array is kept on a list
+// until deque_delete(), since a thief may still be reading from it.
+typedef struct array {
+    int64_t mask; // Capacity - 1 (capacity is a power of two)
+    struct array *retired; // The array this one replaced
+    _Atomic(void *) elems[]; // The elements, indexed by position & mask
+} array_t;
+
+typedef struct deque {
+    alignas(CACHE_LINE_SIZE) _Atomic int64_t top; // Next position to steal, moved by thieves
+    alignas(CACHE_LINE_SIZE) _Atomic int64_t bottom; // Next position to push, owned by the owner
+    _Atomic(array_t *) array; // The current array
+} deque_t;
+
+// Allocate an array with the given capacity
+static array_t *array_new(int64_t capacity) {
+    array_t *a = malloc(sizeof(array_t) + sizeof(_Atomic(void *)) * capacity);
+    if (a == NULL) {
+        fprintf(stderr, "Failed to allocate memory for deque.\n");
+        exit(EXIT_FAILURE);
+    }
+    a->mask = capacity - 1;
+    a->retired = NULL;
+    return a;
+}
+
+// Create a new deque with the specified initial size
+deque_t *deque_new(int size) {
+    int64_t capacity = 1;
+    while (capacity < size) {
+        capacity <<= 1;
+    }
+
+    deque_t *d = aligned_alloc(CACHE_LINE_SIZE, sizeof(deque_t));
+    if (d == NULL) {
+        fprintf(stderr, "Failed to allocate memory for deque.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    atomic_init(&(d->top), 0);
+    atomic_init(&(d->bottom), 0);
+    atomic_init(&(d->array), array_new(capacity));
+    return d;
+}
+
+// Delete the deque, along with every array it has outgrown
+void deque_delete(deque_t **d) {
+    if (d == NULL || *d == NULL) {
+        return;
+    }
+
+    array_t *a = atomic_load_explicit(&((*d)->array), memory_order_relaxed);
+    while (a != NULL) {
+        array_t *retired = a->retired;
+        free(a);
+        a = retired;
+    }
+    free(*d);
+    *d = NULL;
+}
+
+// Replace a full array with one twice its size holding the elements in [top, bottom)
+static array_t *deque_grow(deque_t *d, array_t *a, int64_t top, int64_t bottom) {
+    array_t *bigger = array_new((a->mask + 1) * 2);
+
+    for (int64_t i = top; i < bottom; i++) {
+        void *elem = atomic_load_explicit(&(a->elems[i & a->mask]), memory_order_relaxed);
+        atomic_store_explicit(&(bigger->elems[i & bigger->mask]), elem, memory_order_relaxed);
+    }
+    bigger->retired = a;
+
+    // Thieves that load the new array must see its contents
+    atomic_store_explicit(&(d->array), bigger, memory_order_release);
+    return bigger;
+}
+
+// Push an element onto the bottom (owner only)
+bool deque_push(deque_t *d, void *element) {
+    if (d == NULL) {
+        return false;
+    }
+
+    int64_t bottom = atomic_load_explicit(&(d->bottom), memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&(d->top), memory_order_acquire);
+    array_t *a = atomic_load_explicit(&(d->array), memory_order_relaxed);
+
+    if (bottom - top > a->mask) {
+        a = deque_grow(d, a, top, bottom);
+    }
+
+    // Store the element, then publish it to thieves by moving bottom past it
+    atomic_store_explicit(&(a->elems[bottom & a->mask]), element, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&(d->bottom), bottom + 1, memory_order_relaxed);
+    return true;
+}
+
+// Pop the newest element from the bottom (owner only)
+bool deque_pop(deque_t *d, void **element) {
+    if (d == NULL) {
+        return false;
+    }
+
+    // Reserve the bottom element before looking at top, so a thief that reads bottom after
+    // this point won't take it too
+    int64_t bottom = atomic_load_explicit(&(d->bottom), memory_order_relaxed) - 1;
+    array_t *a = atomic_load_explicit(&(d->array), memory_order_relaxed);
+    atomic_store_explicit(&(d->bottom), bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&(d->top), memory_order_relaxed);
+
+    if (top > bottom) {
+        // Empty; undo the reservation
+        atomic_store_explicit(&(d->bottom), bottom + 1, memory_order_relaxed);
+        return false;
+    }
+
+    *element = atomic_load_explicit(&(a->elems[bottom & a->mask]), memory_order_relaxed);
+    if (top < bottom) {
+        // More than one element left, so no thief can be after this one
+        return true;
+    }
+
+    // Last element: race the thieves for it by moving top
+    bool won = atomic_compare_exchange_strong_explicit(
+        &(d->top), &top, top + 1, memory_order_seq_cst, memory_order_relaxed);
+    atomic_store_explicit(&(d->bottom), bottom + 1, memory_order_relaxed);
+    return won;
+}
+
+// Steal the oldest element from the top (any thread)
+bool deque_steal(deque_t *d, void **element) {
+    if (d == NULL) {
+        return false;
+    }
+
+    int64_t top = atomic_load_explicit(&(d->top), memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&(d->bottom), memory_order_acquire);
+
+    if (top >= bottom) {
+        return false;
+    }
+
+    // Read the element before claiming it; if the claim fails, someone else has it
+    array_t *a = atomic_load_explicit(&(d->array), memory_order_acquire);
+    void *elem = atomic_load_explicit(&(a->elems[top & a->mask]), memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(
+            &(d->top), &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+        return false;
+    }
+
+    *element = elem;
+    return true;
+}
+
+// Approximate number of elements in the deque
+int64_t deque_size(deque_t *d) {
+    int64_t bottom = atomic_load_explicit(&(d->bottom), memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&(d->top), memory_order_relaxed);
+    return bottom > top ? bottom - top : 0;
+}
@@ -0,0 +1,86 @@
+/**
+ * @File deque.h
+ *
+ * A Chase-Lev work-stealing deque. One thread, the owner, pushes and
+ * pops at the bottom; any number of other threads steal from the top.
+ * The owner's operations are plain loads and stores except when the
+ * deque holds a single element, so it can use its deque as a private
+ * stack while idle threads take the oldest work from it.
+ *
+ * @author Ishika Pol
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/** @struct deque_t
+ *
+ *  @brief This typedef renames the struct deque.
+ */
+typedef struct deque deque_t;
+
+/** @brief Dynamically allocates and initializes a new, empty deque.
+ *
+ *  @param size the initial capacity, rounded up to a power of two. The
+ *         deque grows when the owner pushes onto a full one.
+ *
+ *  @return a pointer to a new deque_t
+ */
+deque_t *deque_new(int size);
+
+/** @brief Delete a deque and free all of its memory.
+ *
+ *  @param d the deque to be deleted. *d is set to NULL on return. No
+ *         thread may be using the deque.
+ */
+void deque_delete(deque_t **d);
+
+/** @brief push an element onto the bottom of the deque.
+ *
+ *  Must only be called by the owner.
+ *
+ *  @param d the deque to push an element into.
+ *
+ *  @param elem the element to add
+ *
+ *  @return true unless d is NULL.
+ */
+bool deque_push(deque_t *d, void *elem);
+
+/** @brief pop the most recently pushed element from the bottom.
+ *
+ *  Must only be called by the owner.
+ *
+ *  @param d the deque to pop an element from.
+ *
+ *  @param elem a place to assign the popped element.
+ *
+ *  @return true if an element was popped, false if the deque was empty
+ *          (or a thief took the last element first).
+ */
+bool deque_pop(deque_t *d, void **elem);
+
+/** @brief steal the oldest element from the top.
+ *
+ *  May be called by any thread.
+ *
+ *  @param d the deque to steal from.
+ *
+ *  @param elem a place to assign the stolen element.
+ *
+ *  @return true if an element was stolen, false if the deque was empty
+ *          or another thread won the race for the top element.
+ */
+bool deque_steal(deque_t *d, void **elem);
+
+/** @brief the number of elements in the deque at some recent moment.
+ *
+ *  @param d the deque.
+ *
+ *  @return the element count; only a hint while other threads are
+ *          using the deque.
+ */
+int64_t deque_size(deque_t *d);
@@ -0,0 +1,83 @@
+/**
+ * @File futex.h
+ *
+ * Thin wrappers around the Linux futex system call, shared by the
+ * structures in this directory that park threads on a 32-bit word
+ * instead of a mutex and condition variable.
+ *
+ * @author Ishika Pol
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/** @brief Sleep while *addr still holds val, or until deadline.
+ *
+ *  @param addr the futex word.
+ *
+ *  @param val the value the caller last saw in *addr. If *addr has
+ *  changed since then the call returns immediately.
+ *
+ *  @param deadline an absolute CLOCK_MONOTONIC time to give up at, or
+ *  NULL to wait indefinitely.
+ *
+ *  @return -1 if the deadline passed, 0 otherwise. Spurious returns are
+ *  possible, so callers must re-check their condition in a loop.
+ */
+static inline int futex_wait(
+    _Atomic uint32_t *addr, uint32_t val, const struct timespec *deadline) {
+    // FUTEX_WAIT_BITSET takes an absolute timeout, so retries don't stretch the deadline
+    if (syscall(SYS_futex, (uint32_t *) addr, FUTEX_WAIT_BITSET_PRIVATE, val, deadline, NULL,
+            FUTEX_BITSET_MATCH_ANY)
+            == -1
+        && errno == ETIMEDOUT) {
+        return -1;
+    }
+    return 0;
+}
+
+/** @brief Check whether an absolute CLOCK_MONOTONIC deadline has passed.
+ *
+ *  @param deadline the deadline, or NULL for none.
+ *
+ *  @return true if deadline is set and in the past.
+ */
+static inline bool deadline_passed(const struct timespec *deadline) {
+    struct timespec now;
+
+    if (deadline == NULL) {
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > deadline->tv_sec
+           || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+/** @brief The current CLOCK_MONOTONIC time, for measuring waits.
+ *
+ *  @return the time in nanoseconds.
+ */
+static inline uint64_t monotonic_ns(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/** @brief Wake up to n threads sleeping on addr.
+ *
+ *  @param addr the futex word.
+ *
+ *  @param n the number of threads to wake, or INT32_MAX for all of them.
+ */
+static inline void futex_wake(_Atomic uint32_t *addr, int n) {
+    syscall(SYS_futex, (uint32_t *) addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
@@ -0,0 +1,49 @@
+/**
+ * @File histogram.h
+ *
+ * Log-linear latency histogram buckets, shared by the benchmarks so
+ * their percentiles are computed the same way. Latencies are kept in a
+ * histogram with 8 buckets per power of two, so percentiles are accurate
+ * to within 12.5% without storing every sample.
+ *
+ * @author Ishika Pol
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define SUB_BITS 3
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define BUCKETS (64 * SUB_BUCKETS)
+
+/** @brief The histogram bucket for a latency: exact below 8 ns, then 8
+ *         buckets per power of two.
+ *
+ *  @param ns the latency in nanoseconds.
+ *
+ *  @return a bucket index below BUCKETS.
+ */
+static inline int bucket_of(uint64_t ns) {
+    if (ns < SUB_BUCKETS) {
+        return (int) ns;
+    }
+    int msb = 63 - __builtin_clzll(ns);
+    int sub = (int) ((ns >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1));
+    return ((msb - SUB_BITS + 1) << SUB_BITS) + sub;
+}
+
+/** @brief The largest latency that falls in a bucket.
+ *
+ *  @param bucket a bucket index below BUCKETS.
+ *
+ *  @return the latency in nanoseconds.
+ */
+static inline uint64_t bucket_limit(int bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    int shift = (bucket >> SUB_BITS) - 1;
+    uint64_t low = (uint64_t) (SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1))) << shift;
+    return low + ((uint64_t) 1 << shift) - 1;
+}
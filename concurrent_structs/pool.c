@@ -0,0 +1,255 @@
+// Main File - pool.c
+// Ishika Pol - CSE130
+// Implementation of a work-stealing thread pool built on per-worker Chase-Lev deques.
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "deque.h"
+#include "futex.h"
+#include "pool.h"
+#include "queue.h"
+
+#define CACHE_LINE_SIZE 64
+// Initial capacity of each worker's deque; it grows as needed
+#define DEQUE_SIZE 256
+// Capacity of the queue for tasks submitted from outside the pool
+#define INJECT_QUEUE_SIZE 1024
+
+typedef struct task {
+    pool_task_fn fn; // Function to run
+    void *arg; // Its argument
+} task_t;
+
+// Each worker sits on its own cache line so the owners' fields don't false-share
+typedef struct worker {
+    alignas(CACHE_LINE_SIZE) deque_t *deque; // Tasks submitted by this worker's tasks
+    struct pool *pool; // The pool the worker belongs to
+    pthread_t thread; // The worker thread
+    uint32_t rng; // xorshift state for picking steal victims
+} worker_t;
+
+typedef struct pool {
+    int threads; // Number of workers
+    worker_t *workers; // The workers
+    queue_t *inject; // Tasks submitted from threads outside the pool
+
+    // Tasks submitted but not yet finished; pool_wait() sleeps on done_seq until it is 0
+    alignas(CACHE_LINE_SIZE) _Atomic int64_t pending;
+    _Atomic uint32_t done_seq;
+
+    // Idle workers sleep on work_seq, which is bumped whenever work arrives while any
+    // worker is asleep
+    alignas(CACHE_LINE_SIZE) _Atomic uint32_t work_seq;
+    _Atomic uint32_t sleepers;
+    _Atomic bool stopping;
+} pool_t;
+
+// The worker running on this thread, if the thread belongs to a pool
+static _Thread_local worker_t *current_worker = NULL;
+
+// Pick a worker at random to steal from
+static uint32_t next_random(worker_t *w) {
+    w->rng ^= w->rng << 13;
+    w->rng ^= w->rng >> 17;
+    w->rng ^= w->rng << 5;
+    return w->rng;
+}
+
+// Find a task for a worker: its own deque first (newest first, while it is still in
+// cache), then the shared queue, then the other workers' deques (oldest first)
+static bool pool_find(pool_t *p, worker_t *self, void **elem) {
+    if (deque_pop(self->deque, elem) || queue_try_pop(p->inject, elem)) {
+        return true;
+    }
+
+    int start = next_random(self) % p->threads;
+    for (int i = 0; i < p->threads; i++) {
+        worker_t *victim = &(p->workers[(start + i) % p->threads]);
+        if (victim != self && deque_steal(victim->deque, elem)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Check whether any worker's deque still holds tasks. A steal can lose a race for a task
+// without the deque being empty, so this is checked before going to sleep.
+static bool pool_has_work(pool_t *p) {
+    for (int i = 0; i < p->threads; i++) {
+        if (deque_size(p->workers[i].deque) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Wake one idle worker, if there is one. The fence pairs with the one in pool_worker(),
+// so either the worker sees the new task or we see the worker.
+static void pool_signal(pool_t *p) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&(p->sleepers), memory_order_relaxed) > 0) {
+        atomic_fetch_add_explicit(&(p->work_seq), 1, memory_order_release);
+        futex_wake(&(p->work_seq), 1);
+    }
+}
+
+// Run a task, free it, and wake pool_wait() if it was the last one outstanding
+static void pool_run(pool_t *p, task_t *task) {
+    task->fn(task->arg);
+    free(task);
+
+    if (atomic_fetch_sub_explicit(&(p->pending), 1, memory_order_acq_rel) == 1) {
+        atomic_fetch_add_explicit(&(p->done_seq), 1, memory_order_release);
+        futex_wake(&(p->done_seq), INT32_MAX);
+    }
+}
+
+// Worker thread: run tasks until the pool is stopped, sleeping when there are none
+static void *pool_worker(void *arg) {
+    worker_t *self = (worker_t *) arg;
+    pool_t *p = self->pool;
+    void *elem;
+
+    current_worker = self;
+
+    for (;;) {
+        if (pool_find(p, self, &elem)) {
+            pool_run(p, (task_t *) elem);
+            continue;
+        }
+
+        // Register as a sleeper, then look once more so a task submitted in between can't
+        // be missed
+        atomic_fetch_add_explicit(&(p->sleepers), 1, memory_order_relaxed);
+        uint32_t seq = atomic_load_explicit(&(p->work_seq), memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (pool_find(p, self, &elem)) {
+            atomic_fetch_sub_explicit(&(p->sleepers), 1, memory_order_relaxed);
+            pool_run(p, (task_t *) elem);
+            continue;
+        }
+        if (atomic_load_explicit(&(p->stopping), memory_order_acquire)) {
+            atomic_fetch_sub_explicit(&(p->sleepers), 1, memory_order_relaxed);
+            break;
+        }
+        if (!pool_has_work(p)) {
+            futex_wait(&(p->work_seq), seq, NULL);
+        }
+        atomic_fetch_sub_explicit(&(p->sleepers), 1, memory_order_relaxed);
+    }
+
+    current_worker = NULL;
+    return NULL;
+}
+
+// Create a pool and start its workers
+pool_t *pool_new(int threads) {
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    pool_t *p = aligned_alloc(CACHE_LINE_SIZE, sizeof(pool_t));
+    worker_t *workers = aligned_alloc(CACHE_LINE_SIZE, sizeof(worker_t) * threads);
+    if (p == NULL || workers == NULL) {
+        fprintf(stderr, "Failed to allocate memory for pool.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    p->threads = threads;
+    p->workers = workers;
+    p->inject = queue_new(INJECT_QUEUE_SIZE);
+    atomic_init(&(p->pending), 0);
+    atomic_init(&(p->done_seq), 0);
+    atomic_init(&(p->work_seq), 0);
+    atomic_init(&(p->sleepers), 0);
+    atomic_init(&(p->stopping), false);
+
+    // Create every deque before any worker can try to steal from it
+    for (int i = 0; i < threads; i++) {
+        workers[i].deque = deque_new(DEQUE_SIZE);
+        workers[i].pool = p;
+        workers[i].rng = 2654435761u * (i + 1);
+    }
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&(workers[i].thread), NULL, pool_worker, &(workers[i])) != 0) {
+            fprintf(stderr, "Failed to create pool worker thread.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return p;
+}
+
+// Finish outstanding tasks, stop the workers and free the pool
+void pool_delete(pool_t **p) {
+    if (p == NULL || *p == NULL) {
+        return;
+    }
+
+    pool_t *pool = *p;
+    pool_wait(pool);
+
+    atomic_store_explicit(&(pool->stopping), true, memory_order_release);
+    atomic_fetch_add_explicit(&(pool->work_seq), 1, memory_order_release);
+    futex_wake(&(pool->work_seq), INT32_MAX);
+
+    for (int i = 0; i < pool->threads; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        deque_delete(&(pool->workers[i].deque));
+    }
+
+    queue_delete(&(pool->inject));
+    free(pool->workers);
+    free(pool);
+    *p = NULL;
+}
+
+// Schedule a task on the pool
+bool pool_submit(pool_t *p, pool_task_fn fn, void *arg) {
+    if (p == NULL || fn == NULL) {
+        return false;
+    }
+
+    task_t *task = malloc(sizeof(task_t));
+    if (task == NULL) {
+        fprintf(stderr, "Failed to allocate memory for task.\n");
+        exit(EXIT_FAILURE);
+    }
+    task->fn = fn;
+    task->arg = arg;
+
+    atomic_fetch_add_explicit(&(p->pending), 1, memory_order_relaxed);
+
+    // A task spawned by a task stays on its worker's deque; anything else is shared
+    if (current_worker != NULL && current_worker->pool == p) {
+        deque_push(current_worker->deque, task);
+    } else {
+        queue_push(p->inject, task);
+    }
+
+    pool_signal(p);
+    return true;
+}
+
+// Wait until no submitted task is left unfinished
+void pool_wait(pool_t *p) {
+    if (p == NULL) {
+        return;
+    }
+
+    for (;;) {
+        // Read the sequence before the count, so a last task finishing in between changes
+        // the sequence and the futex wait returns at once
+        uint32_t seq = atomic_load_explicit(&(p->done_seq), memory_order_acquire);
+        if (atomic_load_explicit(&(p->pending), memory_order_acquire) == 0) {
+            return;
+        }
+        futex_wait(&(p->done_seq), seq, NULL);
+    }
+}
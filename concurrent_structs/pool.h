@@ -0,0 +1,66 @@
+/**
+ * @File pool.h
+ *
+ * A fixed-size thread pool that schedules tasks by work stealing. Each
+ * worker owns a deque_t: tasks submitted from inside a task go on the
+ * submitting worker's own deque, and a worker with nothing to do steals
+ * from the others. Tasks submitted from outside the pool go through a
+ * shared queue_t that every worker checks.
+ *
+ * @author Ishika Pol
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/** @struct pool_t
+ *
+ *  @brief This typedef renames the struct pool.
+ */
+typedef struct pool pool_t;
+
+/** @brief A task: a function and the argument it is called with. */
+typedef void (*pool_task_fn)(void *arg);
+
+/** @brief Dynamically allocates a pool and starts its worker threads.
+ *
+ *  @param threads the number of worker threads.
+ *
+ *  @return a pointer to a new pool_t
+ */
+pool_t *pool_new(int threads);
+
+/** @brief Wait for every submitted task to finish, stop the workers and
+ *         free the pool.
+ *
+ *  @param p the pool to be deleted. *p is set to NULL on return.
+ */
+void pool_delete(pool_t **p);
+
+/** @brief Schedule fn(arg) to run on one of the pool's workers.
+ *
+ *  May be called from any thread, including from inside a running
+ *  task, which is the cheap case: the task goes on the calling worker's
+ *  own deque.
+ *
+ *  @param p the pool.
+ *
+ *  @param fn the function to run.
+ *
+ *  @param arg the argument passed to fn.
+ *
+ *  @return true unless p or fn is NULL.
+ */
+bool pool_submit(pool_t *p, pool_task_fn fn, void *arg);
+
+/** @brief Wait until every task submitted so far, and every task those
+ *         tasks submitted, has finished.
+ *
+ *  Must not be called from inside a task.
+ *
+ *  @param p the pool.
+ */
+void pool_wait(pool_t *p);
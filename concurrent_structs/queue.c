@@ -1,46 +1,108 @@
 // Main File - queue.c
 // Ishika Pol - CSE130
-// Implementation of a thread-safe queue using semaphores for controlling access and tracking empty and full slots.
+// Implementation of a bounded multi-producer/multi-consumer queue as a lock-free ring buffer.
 
-// Citation: Used pseudocode from lecture slides
+// Citation: Dmitry Vyukov's bounded MPMC queue
 
-#include <stdlib.h>
-#include <stdio.h>
+#include <stdalign.h>
+#include <stdatomic.h>
 #include <stdbool.h>
-#include <semaphore.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "futex.h"
 #include "queue.h"
 
+#define CACHE_LINE_SIZE 64
+
+// A slot in the ring. seq tells producers and consumers whose turn it is:
+// seq == pos means the slot is free for the producer claiming position pos,
+// seq == pos + 1 means it holds the element pushed at pos.
+typedef struct cell {
+    _Atomic size_t seq; // Turn counter for the slot
+    void *elem; // The element stored in the slot
+} cell_t;
+
+// Parked threads wait on a sequence word that is bumped every time the
+// other side makes progress while someone is waiting.
+typedef struct waitq {
+    _Atomic uint32_t seq; // Futex word, bumped before each wake
+    _Atomic uint32_t waiters; // Number of threads parked or about to park
+} waitq_t;
+
+// Statistics for one side of the queue, see queue_stats_t
+typedef struct op_stats {
+    _Atomic uint64_t count;
+    _Atomic uint64_t waits;
+    _Atomic uint64_t wait_ns;
+    _Atomic uint64_t max_wait_ns;
+} op_stats_t;
+
 typedef struct queue {
-    int size; // Maximum size of the queue
-    int tail; // Index pointing to the next available slot to enqueue
-    int head; // Index pointing to the next available slot to dequeue
-    void **buffer; // The array to hold the elements
-    sem_t mutex; // Semaphore for controlling access to the queue
-    sem_t full_slots; // Semaphore for tracking available slots for elements
-    sem_t empty_slots; // Semaphore for tracking empty slots in the queue
+    // Read-only after queue_new() (or nearly, for stats_on), shared by every thread
+    alignas(CACHE_LINE_SIZE) size_t mask; // Capacity - 1 (capacity is a power of two)
+    cell_t *buffer; // The ring of slots
+    _Atomic bool stats_on; // Whether operations update the statistics below
+
+    // Producers and consumers each get their own cache line so they never false-share
+    alignas(CACHE_LINE_SIZE) _Atomic size_t tail; // Next position to push into
+    alignas(CACHE_LINE_SIZE) _Atomic size_t head; // Next position to pop from
+
+    alignas(CACHE_LINE_SIZE) waitq_t not_full; // Producers waiting for a free slot
+    alignas(CACHE_LINE_SIZE) waitq_t not_empty; // Consumers waiting for an element
+
+    // Statistics, only written while stats_on is set
+    alignas(CACHE_LINE_SIZE) op_stats_t push_stats;
+    op_stats_t pop_stats;
+    _Atomic uint64_t high_water;
 } queue_t;
 
 // Create a new queue with the specified size
 queue_t *queue_new(int size) {
-    queue_t *q = (queue_t *) malloc(sizeof(queue_t));
-    if (q == NULL) {
+    if (size < 1) {
+        size = 1;
+    }
+
+    // Round the capacity up to a power of two so positions map to slots with a mask. It
+    // must be at least 2, or "holds element for pos" and "free for pos + 1" look the same.
+    size_t capacity = 2;
+    while (capacity < (size_t) size) {
+        capacity <<= 1;
+    }
+
+    queue_t *q = aligned_alloc(CACHE_LINE_SIZE, sizeof(queue_t));
+    cell_t *buffer = aligned_alloc(CACHE_LINE_SIZE, sizeof(cell_t) * capacity);
+    if (q == NULL || buffer == NULL) {
         fprintf(stderr, "Failed to allocate memory for queue.\n");
         exit(EXIT_FAILURE);
     }
 
-    q->size = size;
-    q->tail = 0;
-    q->head = 0;
+    q->mask = capacity - 1;
+    q->buffer = buffer;
 
-    // Allocate memory for the element buffer
-    q->buffer = malloc(sizeof(void **) * size);
+    // Every slot starts free for the producer that will claim its index
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&(buffer[i].seq), i);
+        buffer[i].elem = NULL;
+    }
 
-    // Initialize mutex to control access (only one thread at a time)
-    sem_init(&(q->mutex), 0, 1);
-    // Initialize full_slots to 'size' indicating no elements initially
-    sem_init(&(q->full_slots), 0, size);
-    // Initialize empty_slots to '1' indicating one empty slot initially
-    sem_init(&(q->empty_slots), 0, 0);
+    atomic_init(&(q->tail), 0);
+    atomic_init(&(q->head), 0);
+    atomic_init(&(q->not_full.seq), 0);
+    atomic_init(&(q->not_full.waiters), 0);
+    atomic_init(&(q->not_empty.seq), 0);
+    atomic_init(&(q->not_empty.waiters), 0);
+
+    atomic_init(&(q->stats_on), false);
+    op_stats_t *sides[] = { &(q->push_stats), &(q->pop_stats) };
+    for (int i = 0; i < 2; i++) {
+        atomic_init(&(sides[i]->count), 0);
+        atomic_init(&(sides[i]->waits), 0);
+        atomic_init(&(sides[i]->wait_ns), 0);
+        atomic_init(&(sides[i]->max_wait_ns), 0);
+    }
+    atomic_init(&(q->high_water), 0);
 
     return q;
 }
@@ -51,22 +113,185 @@ void queue_delete(queue_t **q) {
         fprintf(stderr, "Error in queue_delete(). Queue doesn't exist.");
         exit(EXIT_FAILURE);
     }
-    if (q && *q) {
-        // Free the memory used by the element buffer
-        if ((*q)->buffer != NULL) {
-            free((*q)->buffer);
+    if (*q) {
+        free((*q)->buffer);
+        free(*q);
+        *q = NULL;
+    }
+}
+
+// Claim up to n consecutive free slots with one CAS on tail and fill them from elems.
+// Returns the number of elements pushed, 0 if the queue is full.
+static int ring_push(queue_t *q, void **elems, int n) {
+    size_t pos = atomic_load_explicit(&(q->tail), memory_order_relaxed);
+    int count;
+
+    for (;;) {
+        // Count how many slots from pos on are free for this lap
+        count = 0;
+        while (count < n) {
+            cell_t *cell = &(q->buffer[(pos + count) & q->mask]);
+            size_t seq = atomic_load_explicit(&(cell->seq), memory_order_acquire);
+            if (seq != pos + count) {
+                break;
+            }
+            count++;
         }
-        (*q)->tail = 0;
-        (*q)->head = 0;
 
-        sem_destroy(&((*q)->full_slots));
-        sem_destroy(&((*q)->empty_slots));
-        sem_destroy(&((*q)->mutex));
+        if (count > 0) {
+            // The slots are free for these positions; race other producers for them
+            if (atomic_compare_exchange_weak_explicit(
+                    &(q->tail), &pos, pos + count, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+            continue;
+        }
 
-        // Free the memory used by the queue
-        free(*q);
-        *q = NULL;
+        size_t now = atomic_load_explicit(&(q->tail), memory_order_relaxed);
+        if (now == pos) {
+            // The slot still holds the element from one lap ago
+            return 0;
+        }
+        // Another producer took this position; catch up
+        pos = now;
+    }
+
+    // Publish the elements to the consumers that will claim these positions
+    for (int i = 0; i < count; i++) {
+        cell_t *cell = &(q->buffer[(pos + i) & q->mask]);
+        cell->elem = elems[i];
+        atomic_store_explicit(&(cell->seq), pos + i + 1, memory_order_release);
+    }
+    return count;
+}
+
+// Claim up to n of the oldest elements with one CAS on head and store them in elems.
+// Returns the number of elements popped, 0 if the queue is empty.
+static int ring_pop(queue_t *q, void **elems, int n) {
+    size_t pos = atomic_load_explicit(&(q->head), memory_order_relaxed);
+    int count;
+
+    for (;;) {
+        // Count how many slots from pos on hold published elements
+        count = 0;
+        while (count < n) {
+            cell_t *cell = &(q->buffer[(pos + count) & q->mask]);
+            size_t seq = atomic_load_explicit(&(cell->seq), memory_order_acquire);
+            if (seq != pos + count + 1) {
+                break;
+            }
+            count++;
+        }
+
+        if (count > 0) {
+            // The slots hold elements for these positions; race other consumers for them
+            if (atomic_compare_exchange_weak_explicit(
+                    &(q->head), &pos, pos + count, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+            continue;
+        }
+
+        size_t now = atomic_load_explicit(&(q->head), memory_order_relaxed);
+        if (now == pos) {
+            // The producer for this position hasn't published yet
+            return 0;
+        }
+        // Another consumer took this position; catch up
+        pos = now;
+    }
+
+    // Hand the slots back to the producers one lap ahead
+    for (int i = 0; i < count; i++) {
+        cell_t *cell = &(q->buffer[(pos + i) & q->mask]);
+        elems[i] = cell->elem;
+        atomic_store_explicit(&(cell->seq), pos + i + q->mask + 1, memory_order_release);
     }
+    return count;
+}
+
+// Raise a counter to at least value
+static void atomic_max(_Atomic uint64_t *counter, uint64_t value) {
+    uint64_t old = atomic_load_explicit(counter, memory_order_relaxed);
+    while (old < value
+           && !atomic_compare_exchange_weak_explicit(
+               counter, &old, value, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+// Record an operation that moved count elements (stats on). waited says whether it found
+// the queue full or empty, and wait_ns how long it then waited.
+static void stats_record(queue_t *q, bool push, int count, bool waited, uint64_t wait_ns) {
+    op_stats_t *stats = push ? &(q->push_stats) : &(q->pop_stats);
+
+    atomic_fetch_add_explicit(&(stats->count), count, memory_order_relaxed);
+    if (waited) {
+        atomic_fetch_add_explicit(&(stats->waits), 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&(stats->wait_ns), wait_ns, memory_order_relaxed);
+        atomic_max(&(stats->max_wait_ns), wait_ns);
+    }
+
+    // Both ends may have moved on since, so this is an estimate of the occupancy
+    if (push && count > 0) {
+        size_t tail = atomic_load_explicit(&(q->tail), memory_order_relaxed);
+        size_t head = atomic_load_explicit(&(q->head), memory_order_relaxed);
+        if (tail > head) {
+            atomic_max(&(q->high_water), tail - head);
+        }
+    }
+}
+
+// Wake up to n parked threads on the other side, if there are any. The fence pairs with
+// the one in queue_wait(), so either the waiter sees our update or we see the waiter.
+static void waitq_wake(waitq_t *w, int n) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&(w->waiters), memory_order_relaxed) > 0) {
+        atomic_fetch_add_explicit(&(w->seq), 1, memory_order_release);
+        futex_wake(&(w->seq), n);
+    }
+}
+
+// Run ring_push() or ring_pop() until it moves at least one element, parking on self while
+// it can't. Wakes the threads waiting on other for what was moved. Returns 0 on timeout.
+static int queue_wait(queue_t *q, int (*op)(queue_t *, void **, int), waitq_t *self,
+    waitq_t *other, void **elems, int n, const struct timespec *deadline) {
+    bool stats = atomic_load_explicit(&(q->stats_on), memory_order_relaxed);
+    uint64_t start = 0;
+    int moved;
+
+    while ((moved = op(q, elems, n)) == 0) {
+        if (stats && start == 0) {
+            start = monotonic_ns();
+        }
+        if (deadline_passed(deadline)) {
+            if (stats) {
+                stats_record(q, op == ring_push, 0, true, monotonic_ns() - start);
+            }
+            return 0;
+        }
+
+        // Register as a waiter, then check again before sleeping so a thread on the
+        // other side that made progress in between can't be missed
+        atomic_fetch_add_explicit(&(self->waiters), 1, memory_order_relaxed);
+        uint32_t seq = atomic_load_explicit(&(self->seq), memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        moved = op(q, elems, n);
+        if (moved == 0) {
+            futex_wait(&(self->seq), seq, deadline);
+        }
+        atomic_fetch_sub_explicit(&(self->waiters), 1, memory_order_relaxed);
+        if (moved > 0) {
+            break;
+        }
+    }
+
+    if (stats) {
+        stats_record(
+            q, op == ring_push, moved, start != 0, start != 0 ? monotonic_ns() - start : 0);
+    }
+    waitq_wake(other, moved);
+    return moved;
 }
 
 // Push an element onto the queue
@@ -74,43 +299,118 @@ bool queue_push(queue_t *q, void *element) {
     if (q == NULL) {
         return false;
     }
+    return queue_wait(q, ring_push, &(q->not_full), &(q->not_empty), &element, 1, NULL) == 1;
+}
 
-    // Wait for an available slot to push the element
-    sem_wait(&(q->full_slots));
-    // Acquire the mutex for safe access to the queue
-    sem_wait(&(q->mutex));
-
-    // Add the element to the queue
-    q->buffer[q->tail] = element;
-    q->tail = (q->tail + 1) % q->size;
+// Pop an element from the queue
+bool queue_pop(queue_t *q, void **element) {
+    if (q == NULL) {
+        return false;
+    }
+    return queue_wait(q, ring_pop, &(q->not_empty), &(q->not_full), element, 1, NULL) == 1;
+}
 
-    // Release the mutex
-    sem_post(&(q->mutex));
-    // Signal that an empty slot is filled
-    sem_post(&(q->empty_slots));
+// Push an element only if there is a free slot right now
+bool queue_try_push(queue_t *q, void *element) {
+    if (q == NULL) {
+        return false;
+    }
+    int moved = ring_push(q, &element, 1);
+    if (atomic_load_explicit(&(q->stats_on), memory_order_relaxed)) {
+        // A push that finds the queue full counts as a wait that lasted no time
+        stats_record(q, true, moved, moved == 0, 0);
+    }
+    if (moved == 0) {
+        return false;
+    }
+    waitq_wake(&(q->not_empty), 1);
+    return true;
+}
 
+// Pop an element only if one is available right now
+bool queue_try_pop(queue_t *q, void **element) {
+    if (q == NULL) {
+        return false;
+    }
+    int moved = ring_pop(q, element, 1);
+    if (atomic_load_explicit(&(q->stats_on), memory_order_relaxed)) {
+        stats_record(q, false, moved, moved == 0, 0);
+    }
+    if (moved == 0) {
+        return false;
+    }
+    waitq_wake(&(q->not_full), 1);
     return true;
 }
 
-// Pop an element from the queue
-bool queue_pop(queue_t *q, void **element) {
+// Push an element, waiting for a free slot until the deadline
+bool queue_timed_push(queue_t *q, void *element, const struct timespec *deadline) {
     if (q == NULL) {
         return false;
     }
+    return queue_wait(q, ring_push, &(q->not_full), &(q->not_empty), &element, 1, deadline)
+           == 1;
+}
 
-    // Wait for an element to be available
-    sem_wait(&(q->empty_slots));
-    // Acquire the mutex for safe access to the queue
-    sem_wait(&(q->mutex));
+// Pop an element, waiting for one to arrive until the deadline
+bool queue_timed_pop(queue_t *q, void **element, const struct timespec *deadline) {
+    if (q == NULL) {
+        return false;
+    }
+    return queue_wait(q, ring_pop, &(q->not_empty), &(q->not_full), element, 1, deadline)
+           == 1;
+}
 
-    // Retrieve the element from the queue
-    *element = q->buffer[q->head];
-    q->head = (q->head + 1) % q->size;
+// Push up to n elements with a single claim on the ring
+int queue_push_many(queue_t *q, void **elements, int n, const struct timespec *deadline) {
+    if (q == NULL || n <= 0) {
+        return 0;
+    }
+    return queue_wait(q, ring_push, &(q->not_full), &(q->not_empty), elements, n, deadline);
+}
 
-    // Release the mutex
-    sem_post(&(q->mutex));
-    // Signal that a full slot is emptied
-    sem_post(&(q->full_slots));
+// Pop up to n elements with a single claim on the ring
+int queue_pop_many(queue_t *q, void **elements, int n, const struct timespec *deadline) {
+    if (q == NULL || n <= 0) {
+        return 0;
+    }
+    return queue_wait(q, ring_pop, &(q->not_empty), &(q->not_full), elements, n, deadline);
+}
 
-    return true;
+// Turn statistics on or off
+void queue_stats_enable(queue_t *q, bool enable) {
+    if (q != NULL) {
+        atomic_store_explicit(&(q->stats_on), enable, memory_order_relaxed);
+    }
+}
+
+// Copy the statistics
+void queue_get_stats(queue_t *q, queue_stats_t *stats) {
+    if (q == NULL || stats == NULL) {
+        return;
+    }
+
+    stats->pushes = atomic_load_explicit(&(q->push_stats.count), memory_order_relaxed);
+    stats->push_waits = atomic_load_explicit(&(q->push_stats.waits), memory_order_relaxed);
+    stats->push_wait_ns = atomic_load_explicit(&(q->push_stats.wait_ns), memory_order_relaxed);
+    stats->push_max_wait_ns
+        = atomic_load_explicit(&(q->push_stats.max_wait_ns), memory_order_relaxed);
+    stats->pops = atomic_load_explicit(&(q->pop_stats.count), memory_order_relaxed);
+    stats->pop_waits = atomic_load_explicit(&(q->pop_stats.waits), memory_order_relaxed);
+    stats->pop_wait_ns = atomic_load_explicit(&(q->pop_stats.wait_ns), memory_order_relaxed);
+    stats->pop_max_wait_ns
+        = atomic_load_explicit(&(q->pop_stats.max_wait_ns), memory_order_relaxed);
+    stats->high_water = atomic_load_explicit(&(q->high_water), memory_order_relaxed);
+}
+
+// Estimate the occupancy from the two ends
+size_t queue_length(queue_t *q) {
+    if (q == NULL) {
+        return 0;
+    }
+
+    // The ends move independently, so a stale tail could even read as behind head
+    size_t head = atomic_load_explicit(&(q->head), memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&(q->tail), memory_order_relaxed);
+    return tail > head ? tail - head : 0;
 }
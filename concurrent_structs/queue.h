@@ -9,8 +9,10 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
+#include <time.h>
 
 /** @struct queue_t
  *
@@ -19,10 +21,30 @@
  */
 typedef struct queue queue_t;
 
-/** @brief Dynamically allocates and initializes a new queue with a
- *         maximum size, size
+/** @brief A snapshot of a queue's statistics, see queue_stats_enable().
  *
- *  @param size the maximum size of the queue
+ *  A wait is an operation that found the queue full (push) or empty
+ *  (pop) and had to wait or give up; the wait times cover every wait,
+ *  including ones that timed out.
+ */
+typedef struct queue_stats {
+    uint64_t pushes; // Elements pushed
+    uint64_t push_waits; // Pushes that found the queue full
+    uint64_t push_wait_ns; // Total time pushes spent waiting
+    uint64_t push_max_wait_ns; // Longest wait of a single push
+    uint64_t pops; // Elements popped
+    uint64_t pop_waits; // Pops that found the queue empty
+    uint64_t pop_wait_ns; // Total time pops spent waiting
+    uint64_t pop_max_wait_ns; // Longest wait of a single pop
+    uint64_t high_water; // Most elements the queue has held at once
+} queue_stats_t;
+
+/** @brief Dynamically allocates and initializes a new queue that holds
+ *         at least size elements
+ *
+ *  @param size the requested capacity.  The queue's actual capacity is
+ *  size rounded up to a power of two, and at least 2, so queue_new(5)
+ *  holds 8 elements and queue_new(1) holds 2 before a push blocks.
  *
  *  @return a pointer to a new queue_t
  */
@@ -58,3 +80,122 @@ bool queue_push(queue_t *q, void *elem);
  *          should succeed unless the q parameter is NULL.
  */
 bool queue_pop(queue_t *q, void **elem);
+
+/** @brief push an element onto a queue without blocking.
+ *
+ *  @param q the queue to push an element into.
+ *
+ *  @param elem the element to add to the queue
+ *
+ *  @return true if the element was added, false if the queue was full
+ *          (or q is NULL).
+ */
+bool queue_try_push(queue_t *q, void *elem);
+
+/** @brief pop an element from a queue without blocking.
+ *
+ *  @param q the queue to pop an element from.
+ *
+ *  @param elem a place to assign the popped element.
+ *
+ *  @return true if an element was popped, false if the queue was empty
+ *          (or q is NULL).
+ */
+bool queue_try_pop(queue_t *q, void **elem);
+
+/** @brief push an element onto a queue, waiting at most until deadline
+ *         for a free slot.
+ *
+ *  @param q the queue to push an element into.
+ *
+ *  @param elem the element to add to the queue
+ *
+ *  @param deadline an absolute CLOCK_MONOTONIC time, or NULL to wait
+ *         indefinitely.
+ *
+ *  @return true if the element was added, false on timeout (or if q is
+ *          NULL).
+ */
+bool queue_timed_push(queue_t *q, void *elem, const struct timespec *deadline);
+
+/** @brief pop an element from a queue, waiting at most until deadline
+ *         for one to arrive.
+ *
+ *  @param q the queue to pop an element from.
+ *
+ *  @param elem a place to assign the popped element.
+ *
+ *  @param deadline an absolute CLOCK_MONOTONIC time, or NULL to wait
+ *         indefinitely.
+ *
+ *  @return true if an element was popped, false on timeout (or if q is
+ *          NULL).
+ */
+bool queue_timed_pop(queue_t *q, void **elem, const struct timespec *deadline);
+
+/** @brief push up to n elements onto a queue in one operation.
+ *
+ *  Waits until at least one slot is free, then pushes as many of the
+ *  elements as fit, in order, with a single claim on the queue.
+ *
+ *  @param q the queue to push the elements into.
+ *
+ *  @param elems the elements to add to the queue.
+ *
+ *  @param n the number of elements in elems.
+ *
+ *  @param deadline an absolute CLOCK_MONOTONIC time to give up at, or
+ *         NULL to wait indefinitely. A deadline in the past never waits.
+ *
+ *  @return the number of elements pushed (the first ones in elems), or
+ *          0 on timeout.
+ */
+int queue_push_many(queue_t *q, void **elems, int n, const struct timespec *deadline);
+
+/** @brief pop up to n elements from a queue in one operation.
+ *
+ *  Waits until at least one element is available, then pops as many as
+ *  are queued, up to n, with a single claim on the queue.
+ *
+ *  @param q the queue to pop the elements from.
+ *
+ *  @param elems a place to store the popped elements, oldest first.
+ *
+ *  @param n the room in elems.
+ *
+ *  @param deadline an absolute CLOCK_MONOTONIC time to give up at, or
+ *         NULL to wait indefinitely. A deadline in the past never waits.
+ *
+ *  @return the number of elements popped, or 0 on timeout.
+ */
+int queue_pop_many(queue_t *q, void **elems, int n, const struct timespec *deadline);
+
+/** @brief Turn statistics on or off for a queue. They are off when the
+ *         queue is created, and cost one predictable branch per call
+ *         while off. While on, every operation updates shared counters,
+ *         and blocking operations that have to wait read the clock.
+ *
+ *  @param q the queue.
+ *
+ *  @param enable whether to collect statistics.
+ */
+void queue_stats_enable(queue_t *q, bool enable);
+
+/** @brief Copy a queue's statistics, counted while they were enabled.
+ *
+ *  @param q the queue.
+ *
+ *  @param stats a place to store the snapshot. Each counter is read
+ *  atomically, but not all of them at the same instant.
+ */
+void queue_get_stats(queue_t *q, queue_stats_t *stats);
+
+/** @brief Estimate how many elements a queue holds.
+ *
+ *  @param q the queue.
+ *
+ *  @return the elements pushed but not yet popped when the two ends
+ *  were read. Both ends may move while they are read, so this is only
+ *  an estimate, meant for monitoring.
+ */
+size_t queue_length(queue_t *q);
@@ -0,0 +1,316 @@
+// Main File - rwbench.c
+// Ishika Pol - CSE130
+// Micro-benchmark comparing read-mostly throughput of the rwlock_t implementations and
+// seqlock_t, with pthread_rwlock_t as a reference. For each thread count every thread loops over short read
+// or write critical sections for a fixed time, and the total operations per second are printed
+// along with the context switches the run took. With -f two threads write back to back while
+// the rest read, and the most reads the lock let in ahead of a queued writer is checked against
+// the priority's bound: n under N_WAY, none under WRITERS. The run fails if it is exceeded.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "rwlock.h"
+#include "seqlock.h"
+
+#define DEFAULT_MAX_THREADS 8
+#define DEFAULT_DURATION_MS 500
+// Writes per 1000 operations; our per-URI locks see well under 1%
+#define DEFAULT_WRITE_PERMILLE 10
+#define DEFAULT_NWAY 8
+// Threads that only write in a fairness run
+#define FAIR_WRITERS 2
+
+typedef enum { IMPL_PTHREAD, IMPL_DEFAULT, IMPL_BIG_READER, IMPL_SEQLOCK } impl_t;
+
+static const char *impl_names[]
+    = { "pthread_rwlock", "rwlock default", "rwlock big-reader", "seqlock" };
+
+// Everything the benchmark threads share
+typedef struct bench {
+    impl_t impl;
+    rwlock_t *rw;
+    pthread_rwlock_t prw;
+    seqlock_t *seq;
+    int write_permille;
+    bool fair; // Fairness run: writer threads only write and the rest only read
+    _Atomic bool start;
+    _Atomic bool stop;
+    // What the critical sections read and write. Atomic only because seqlock readers race
+    // with the writer; relaxed loads and stores are plain moves.
+    _Atomic uint64_t data[8];
+} bench_t;
+
+// Per-thread results, padded so the counters don't false-share
+typedef struct worker {
+    bench_t *bench;
+    uint32_t seed;
+    bool writer; // Only writes (fairness runs)
+    uint64_t reads;
+    uint64_t writes;
+    char pad[64];
+} worker_t;
+
+double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void bench_read_lock(bench_t *b) {
+    if (b->impl == IMPL_PTHREAD) {
+        pthread_rwlock_rdlock(&(b->prw));
+    } else {
+        reader_lock(b->rw);
+    }
+}
+
+void bench_read_unlock(bench_t *b) {
+    if (b->impl == IMPL_PTHREAD) {
+        pthread_rwlock_unlock(&(b->prw));
+    } else {
+        reader_unlock(b->rw);
+    }
+}
+
+void bench_write_lock(bench_t *b) {
+    if (b->impl == IMPL_PTHREAD) {
+        pthread_rwlock_wrlock(&(b->prw));
+    } else if (b->impl == IMPL_SEQLOCK) {
+        seqlock_write_begin(b->seq);
+    } else {
+        writer_lock(b->rw);
+    }
+}
+
+void bench_write_unlock(bench_t *b) {
+    if (b->impl == IMPL_PTHREAD) {
+        pthread_rwlock_unlock(&(b->prw));
+    } else if (b->impl == IMPL_SEQLOCK) {
+        seqlock_write_end(b->seq);
+    } else {
+        writer_unlock(b->rw);
+    }
+}
+
+// The read critical section
+uint64_t read_data(bench_t *b) {
+    uint64_t sum = 0;
+
+    for (int i = 0; i < 8; i++) {
+        sum += atomic_load_explicit(&(b->data[i]), memory_order_relaxed);
+    }
+    return sum;
+}
+
+// The write critical section
+void write_data(bench_t *b) {
+    for (int i = 0; i < 8; i++) {
+        uint64_t value = atomic_load_explicit(&(b->data[i]), memory_order_relaxed);
+        atomic_store_explicit(&(b->data[i]), value + 1, memory_order_relaxed);
+    }
+}
+
+// Benchmark thread: wait for the start signal, then read or write until told to stop
+void *bench_thread(void *arg) {
+    worker_t *w = (worker_t *) arg;
+    bench_t *b = w->bench;
+    volatile uint64_t sink = 0;
+    bool write;
+
+    while (!atomic_load_explicit(&(b->start), memory_order_acquire)) {
+    }
+
+    while (!atomic_load_explicit(&(b->stop), memory_order_relaxed)) {
+        if (b->fair) {
+            write = w->writer;
+        } else {
+            w->seed = w->seed * 1103515245 + 12345;
+            write = (int) ((w->seed >> 16) % 1000) < b->write_permille;
+        }
+
+        if (write) {
+            bench_write_lock(b);
+            write_data(b);
+            bench_write_unlock(b);
+            w->writes++;
+        } else if (b->impl == IMPL_SEQLOCK) {
+            // Readers never write shared memory; they just retry if a write got in
+            uint32_t start;
+            do {
+                start = seqlock_read_begin(b->seq);
+                sink += read_data(b);
+            } while (seqlock_read_retry(b->seq, start));
+            w->reads++;
+        } else {
+            bench_read_lock(b);
+            sink += read_data(b);
+            bench_read_unlock(b);
+            w->reads++;
+        }
+    }
+    (void) sink;
+    return NULL;
+}
+
+// Context switches, voluntary and involuntary, of the whole process so far
+long context_switches(void) {
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+// Results of one run
+typedef struct result {
+    double rate; // Operations per second
+    uint64_t writes; // Writes completed
+    long switches; // Context switches during the run
+    uint64_t reads_ahead; // Most reads let in ahead of one queued writer (fairness runs)
+} result_t;
+
+// Run one implementation with the given number of threads
+result_t run(impl_t impl, PRIORITY priority, uint32_t n, int threads, int duration_ms,
+    int write_permille, bool fair) {
+    bench_t b = { 0 };
+    result_t result = { 0 };
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    worker_t *workers = calloc(threads, sizeof(worker_t));
+    double start, elapsed;
+    long switches;
+    uint64_t ops = 0;
+
+    if (tids == NULL || workers == NULL) {
+        fprintf(stderr, "Failed to allocate benchmark threads\n");
+        exit(1);
+    }
+
+    b.impl = impl;
+    b.write_permille = write_permille;
+    b.fair = fair;
+    if (impl == IMPL_PTHREAD) {
+        pthread_rwlock_init(&(b.prw), NULL);
+    } else if (impl == IMPL_SEQLOCK) {
+        b.seq = seqlock_new();
+    } else {
+        b.rw = rwlock_new_mode(
+            priority, n, impl == IMPL_BIG_READER ? RWLOCK_BIG_READER : RWLOCK_DEFAULT);
+        // The lock counts the reads it lets in ahead of each writer itself, which an outside
+        // count can't do exactly: it can't tell when a writer has actually queued
+        rwlock_stats_enable(b.rw, fair);
+    }
+
+    for (int i = 0; i < threads; i++) {
+        workers[i].bench = &b;
+        workers[i].seed = 2654435761u * (i + 1);
+        workers[i].writer = i < FAIR_WRITERS;
+        pthread_create(&tids[i], NULL, bench_thread, &workers[i]);
+    }
+
+    switches = context_switches();
+    start = now_ns();
+    atomic_store_explicit(&(b.start), true, memory_order_release);
+    usleep(duration_ms * 1000);
+    atomic_store_explicit(&(b.stop), true, memory_order_relaxed);
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    elapsed = now_ns() - start;
+    result.switches = context_switches() - switches;
+
+    for (int i = 0; i < threads; i++) {
+        ops += workers[i].reads + workers[i].writes;
+        result.writes += workers[i].writes;
+    }
+    result.rate = ops / (elapsed / 1e9);
+
+    if (impl == IMPL_PTHREAD) {
+        pthread_rwlock_destroy(&(b.prw));
+    } else if (impl == IMPL_SEQLOCK) {
+        seqlock_delete(&(b.seq));
+    } else {
+        rwlock_stats_t stats;
+        rwlock_get_stats(b.rw, &stats);
+        result.reads_ahead = stats.max_reads_ahead;
+        rwlock_delete(&(b.rw));
+    }
+    free(tids);
+    free(workers);
+
+    return result;
+}
+
+int main(int argc, char **argv) {
+    int max_threads = DEFAULT_MAX_THREADS, duration_ms = DEFAULT_DURATION_MS;
+    int write_permille = DEFAULT_WRITE_PERMILLE, opt;
+    PRIORITY priority = N_WAY;
+    uint32_t n = DEFAULT_NWAY;
+    bool fair = false, failed = false;
+    result_t r;
+
+    while ((opt = getopt(argc, argv, "d:fn:p:t:w:")) != -1) {
+        switch (opt) {
+        case 'd': duration_ms = atoi(optarg); break;
+        case 'f': fair = true; break;
+        case 'n': n = (uint32_t) atoi(optarg); break;
+        case 'p': priority = (PRIORITY) atoi(optarg); break;
+        case 't': max_threads = atoi(optarg); break;
+        case 'w': write_permille = atoi(optarg); break;
+        default:
+            fprintf(stderr,
+                "usage: %s [-d ms] [-f] [-n nway] [-p priority 0-2] [-t max_threads] "
+                "[-w writes_per_1000]\n",
+                argv[0]);
+            exit(1);
+        }
+    }
+    if (max_threads < 1 || duration_ms < 1 || write_permille < 0 || write_permille > 1000
+        || priority < READERS || priority > N_WAY) {
+        fprintf(stderr, "Invalid arguments\n");
+        exit(1);
+    }
+
+    if (fair) {
+        printf("%d writer threads, priority %d, n %u, %d ms per run, %ld CPUs\n", FAIR_WRITERS,
+            priority, n, duration_ms, sysconf(_SC_NPROCESSORS_ONLN));
+    } else {
+        printf("%d writes per 1000 operations, priority %d, %d ms per run, %ld CPUs\n",
+            write_permille, priority, duration_ms, sysconf(_SC_NPROCESSORS_ONLN));
+    }
+    printf("threads  %-18s %14s %12s %10s %s\n", "implementation", "ops/sec", "writes",
+        "switches", fair ? "max reads ahead" : "");
+
+    // Double the thread count up to the maximum, always including the maximum itself; a
+    // fairness run needs at least one reader besides the writers
+    int threads = fair ? FAIR_WRITERS + 1 : 1;
+    for (;; threads = threads * 2 > max_threads ? max_threads : threads * 2) {
+        // Seqlock readers are never held back, so there is no fairness to check
+        for (int impl = IMPL_PTHREAD; impl <= (fair ? IMPL_BIG_READER : IMPL_SEQLOCK); impl++) {
+            r = run((impl_t) impl, priority, n, threads, duration_ms, write_permille, fair);
+            printf("%7d  %-18s %14.0f %12lu %10ld", threads, impl_names[impl], r.rate,
+                (unsigned long) r.writes, r.switches);
+            // pthread_rwlock_t can't report its count, and READERS priority sets no bound
+            if (fair && impl == IMPL_PTHREAD) {
+                printf(" -");
+            } else if (fair) {
+                bool over = (priority == N_WAY && r.reads_ahead > n)
+                            || (priority == WRITERS && r.reads_ahead > 0);
+                printf(" %lu%s", (unsigned long) r.reads_ahead, over ? " FAIL" : "");
+                failed = failed || over;
+            }
+            printf("\n");
+        }
+        if (threads >= max_threads) {
+            break;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
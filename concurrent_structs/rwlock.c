@@ -1,52 +1,163 @@
 // Main File - rwlock.c
 // Ishika Pol - CSE130
-// Implementation of a reader-writer lock with priority levels, N-Way priority, and thread synchronization using pthreads.
+// Implementation of a reader-writer lock with priority levels, N-Way priority, a futex-based fast path,
+// and an optional big-reader mode with per-thread reader slots.
 
 // Citation: Used pseudocode from Mitchell's section
 
 #include "rwlock.h"
 #include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <stdbool.h>
+#include <unistd.h>
+#include "futex.h"
+
+// Layout of the state word. Every acquire and release changes it with one atomic operation;
+// the mutex is only taken once someone has to wait.
+#define WRITER (1u << 31) // A writer holds the lock
+#define WAITING (1u << 30) // Threads are waiting, so the fast paths must not be used
+#define UPGRADER (1u << 29) // An upgradable reader holds the lock
+#define READER_MASK (UPGRADER - 1) // Number of plain readers holding the lock
+
+#define CACHE_LINE_SIZE 64
+// Upper bound on the reader slots of a big-reader lock
+#define MAX_READER_SLOTS 64
+
+// The ways a thread can hold the state word
+typedef enum { ROLE_READER, ROLE_WRITER, ROLE_UPGRADER } role_t;
+
+// A thread waiting in the slow path. It lives on the waiting thread's stack and the thread
+// sleeps on its own granted word, so a release can wake exactly the threads it lets in.
+typedef struct waiter {
+    _Atomic uint32_t granted; // Set once the lock has been handed to this thread
+    uint64_t queued_at; // The lock's reads_admitted when this thread queued
+    struct waiter *next; // The next thread waiting in the same role
+} waiter_t;
+
+// Statistics for one kind of acquisition, see rwlock_stats_t
+typedef struct op_stats {
+    _Atomic uint64_t count;
+    _Atomic uint64_t waits;
+    _Atomic uint64_t wait_ns;
+    _Atomic uint64_t max_wait_ns;
+} op_stats_t;
+
+// A big-reader lock's per-thread reader count, alone on its cache line so a reader only
+// ever writes to a line no other core is using
+typedef struct reader_slot {
+    alignas(CACHE_LINE_SIZE) _Atomic int32_t readers;
+} reader_slot_t;
 
 typedef struct rwlock {
+    _Atomic uint32_t state; // WRITER | WAITING | UPGRADER | reader count
+
     int priority; // Priority level (READERS, WRITERS, N_WAY)
-    int n; // Parameter for N_WAY priority
-    int active_readers; // Number of currently active readers
-    int active_writers; // Number of currently active writers
-    int waiting_readers; // Number of readers waiting to acquire the lock
-    int waiting_writers; // Number of writers waiting to acquire the lock
-    int nway_count; // Counter for N_WAY priority
-    bool flag; // Flag for N_WAY priority
-    pthread_mutex_t mutex; // Mutex for controlling access to the lock
-    pthread_cond_t readers_cond; // Condition variable for readers
-    pthread_cond_t writers_cond; // Condition variable for writers
+    uint32_t n; // Parameter for N_WAY priority
+    _Atomic bool stats_on; // Whether acquisitions update the statistics
+
+    // Slow path, protected by mutex
+    pthread_mutex_t mutex; // Mutex for the waiting threads' bookkeeping
+    uint32_t waiting[3]; // Number of threads waiting in each role
+    waiter_t *head[3]; // The threads waiting in each role, oldest first
+    waiter_t *tail[3];
+    bool upgrading; // The upgradable reader is waiting for readers to drain
+    uint32_t nway_count; // Readers admitted while a writer waited (N_WAY)
+    uint64_t reads_admitted; // Readers let in by the slow path; the fast paths are closed
+                             // while anyone waits, so these are all a queued writer can see
+    uint64_t last_writer_at; // reads_admitted when the last writer got the lock here
+    _Atomic uint32_t upgrade_seq; // Futex word the upgrading reader sleeps on
+
+    // Big-reader mode only
+    RWLOCK_MODE mode; // RWLOCK_DEFAULT or RWLOCK_BIG_READER
+    uint32_t nslots; // Number of reader slots
+    reader_slot_t *slots; // Reader counts, one slot per thread (modulo nslots)
+    _Atomic uint32_t writers_pending; // Writers holding, draining or queued for the lock
+    _Atomic uint32_t drain_seq; // Futex word a draining writer sleeps on
+
+    // Statistics, only written while stats_on is set
+    alignas(CACHE_LINE_SIZE) op_stats_t read_stats;
+    op_stats_t write_stats;
+    _Atomic uint64_t max_reads_ahead; // Most readers let in ahead of one queued writer
 } rwlock_t;
 
+// Index of the calling thread's reader slot, handed out round-robin on first use
+static _Atomic uint32_t next_slot_index = 0;
+static _Thread_local int64_t slot_index = -1;
+// Number of CPUs, looked up when the first big-reader lock is created
+static _Atomic long online_cpus = 0;
+// Whether the calling thread's current acquisition has had to wait, and for how long. The
+// slow paths fill these in, since they are about to sleep anyway, and the public calls fold
+// them into the lock's statistics, if they are on, when the acquisition is done.
+static _Thread_local bool waited = false;
+static _Thread_local uint64_t waited_ns = 0;
+// How long the calling thread's last acquisition attempt slept
+static _Thread_local uint64_t last_wait_ns = 0;
+
 // Create a new read-write lock with the specified priority type
 rwlock_t *rwlock_new(PRIORITY p, uint32_t n) {
-    rwlock_t *rw = (rwlock_t *) malloc(sizeof(rwlock_t));
+    return rwlock_new_mode(p, n, RWLOCK_DEFAULT);
+}
+
+// Create a new read-write lock with the specified priority type and implementation
+rwlock_t *rwlock_new_mode(PRIORITY p, uint32_t n, RWLOCK_MODE mode) {
+    rwlock_t *rw = aligned_alloc(CACHE_LINE_SIZE, sizeof(rwlock_t));
     if (rw == NULL) {
         fprintf(stderr, "Failed to allocate memory for rwlock.\n");
         exit(EXIT_FAILURE);
     }
 
+    atomic_init(&(rw->state), 0);
     rw->priority = p;
     rw->n = n;
-    rw->active_readers = 0;
-    rw->active_writers = 0;
-    rw->waiting_readers = 0;
-    rw->waiting_writers = 0;
+    atomic_init(&(rw->stats_on), false);
+    op_stats_t *kinds[] = { &(rw->read_stats), &(rw->write_stats) };
+    for (int i = 0; i < 2; i++) {
+        atomic_init(&(kinds[i]->count), 0);
+        atomic_init(&(kinds[i]->waits), 0);
+        atomic_init(&(kinds[i]->wait_ns), 0);
+        atomic_init(&(kinds[i]->max_wait_ns), 0);
+    }
+    for (int role = ROLE_READER; role <= ROLE_UPGRADER; role++) {
+        rw->waiting[role] = 0;
+        rw->head[role] = NULL;
+        rw->tail[role] = NULL;
+    }
+    rw->upgrading = false;
     rw->nway_count = 0;
-    rw->flag = false;
+    rw->reads_admitted = 0;
+    rw->last_writer_at = 0;
+    atomic_init(&(rw->max_reads_ahead), 0);
+    atomic_init(&(rw->upgrade_seq), 0);
 
-    // Initialize the mutex for synchronization
+    // Initialize the mutex for the slow path
     pthread_mutex_init(&(rw->mutex), NULL);
 
-    // Initialize condition variables for readers and writers
-    pthread_cond_init(&(rw->readers_cond), NULL);
-    pthread_cond_init(&(rw->writers_cond), NULL);
+    // A big-reader lock gets one slot per CPU; threads beyond that share slots
+    rw->mode = mode;
+    rw->nslots = 0;
+    rw->slots = NULL;
+    atomic_init(&(rw->writers_pending), 0);
+    atomic_init(&(rw->drain_seq), 0);
+    if (mode == RWLOCK_BIG_READER) {
+        long cpus = atomic_load_explicit(&online_cpus, memory_order_relaxed);
+        if (cpus == 0) {
+            cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            atomic_store_explicit(&online_cpus, cpus, memory_order_relaxed);
+        }
+        rw->nslots = cpus < 1 ? 1 : (cpus > MAX_READER_SLOTS ? MAX_READER_SLOTS : cpus);
+        rw->slots = aligned_alloc(CACHE_LINE_SIZE, sizeof(reader_slot_t) * rw->nslots);
+        if (rw->slots == NULL) {
+            fprintf(stderr, "Failed to allocate memory for rwlock.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (uint32_t i = 0; i < rw->nslots; i++) {
+            atomic_init(&(rw->slots[i].readers), 0);
+        }
+    }
 
     return rw;
 }
@@ -57,193 +168,638 @@ void rwlock_delete(rwlock_t **rw) {
         return;
     }
 
-    // Retrieve the reader-writer lock from the pointer
-    rwlock_t *lock = *rw;
+    pthread_mutex_destroy(&((*rw)->mutex));
+    free((*rw)->slots);
+    free(*rw);
+    *rw = NULL;
+}
 
-    // Destroy the associated mutex, signaling condition variables, and free any dynamically allocated memory
-    pthread_mutex_destroy(&(lock->mutex));
-    pthread_cond_destroy(&(lock->readers_cond));
-    pthread_cond_destroy(&(lock->writers_cond));
+// Start timing a wait; only the slow paths call this, right before they may sleep
+static uint64_t wait_begin(void) {
+    return monotonic_ns();
+}
 
-    // Free the memory occupied by the reader-writer lock
-    free(lock);
-    *rw = NULL;
+// Add a wait timed from start to the calling thread's current acquisition
+static void wait_end(uint64_t start) {
+    if (start != 0) {
+        waited = true;
+        waited_ns += monotonic_ns() - start;
+    }
 }
 
-// Helper function that returns the count of threads waiting for the lock based on the lock's priority and current state
-int reader_wait(rwlock_t *rw) {
-    // If priority is readers, it returns the count of active writers
-    if (rw->priority == READERS) {
-        return rw->active_writers;
-    }
-    // If priority is writers, it returns the count of waiting writers
-    else if (rw->priority == WRITERS) {
-        return rw->waiting_writers;
-    }
-    // If priority is N_WAY, it considers the number of active readers, waiting writers, and a condition based on nway_count and flag
-    else if (rw->priority == N_WAY) {
-        if (rw->active_readers > 0) {
-            if (rw->waiting_writers > 0) {
-                if (rw->nway_count < rw->n) {
-                    return 0;
-                } else {
-                    if (rw->flag == true) {
-                        return rw->waiting_writers;
-                    }
-                }
-            } else {
-                return 0;
-            }
-        } else if (rw->active_writers > 0) {
-            return rw->active_writers;
-        } else {
-            if (rw->flag) {
-                return rw->waiting_writers;
-            } else {
-                return 0;
-            }
+// Raise a counter to at least value
+static void atomic_max(_Atomic uint64_t *counter, uint64_t value) {
+    uint64_t old = atomic_load_explicit(counter, memory_order_relaxed);
+    while (old < value
+           && !atomic_compare_exchange_weak_explicit(
+               counter, &old, value, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+// Finish a read or write acquisition attempt: remember its wait for rwlock_last_wait_ns(),
+// and count it, along with that wait, if statistics are on. Returns acquired.
+static bool stats_acquired(rwlock_t *rw, bool write, bool acquired) {
+    last_wait_ns = waited_ns;
+    if (atomic_load_explicit(&(rw->stats_on), memory_order_relaxed)) {
+        op_stats_t *stats = write ? &(rw->write_stats) : &(rw->read_stats);
+        if (acquired) {
+            atomic_fetch_add_explicit(&(stats->count), 1, memory_order_relaxed);
+        }
+        if (waited) {
+            atomic_fetch_add_explicit(&(stats->waits), 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&(stats->wait_ns), waited_ns, memory_order_relaxed);
+            atomic_max(&(stats->max_wait_ns), waited_ns);
+        }
+    }
+    if (waited) {
+        waited = false;
+        waited_ns = 0;
+    }
+    return acquired;
+}
+
+// Number of writers waiting, counting an upgradable reader that is waiting to upgrade
+static uint32_t writers_waiting(rwlock_t *rw) {
+    return rw->waiting[ROLE_WRITER] + rw->upgrading;
+}
+
+// Whether a thread may take the lock in the given role and state (mutex held)
+static bool may_enter(rwlock_t *rw, role_t role, uint32_t state) {
+    if (state & WRITER) {
+        return false;
+    }
+
+    // Readers and the upgradable reader follow the same priority rules; there is just
+    // never more than one upgradable reader
+    if (role == ROLE_READER || role == ROLE_UPGRADER) {
+        if (role == ROLE_UPGRADER && (state & UPGRADER)) {
+            return false;
+        }
+        switch (rw->priority) {
+        case READERS: return true;
+        case WRITERS: return writers_waiting(rw) == 0;
+        case N_WAY: return writers_waiting(rw) == 0 || rw->nway_count < rw->n;
+        }
+        return false;
+    }
+
+    if (state & (UPGRADER | READER_MASK)) {
+        return false;
+    }
+    uint32_t readers_waiting = rw->waiting[ROLE_READER] + rw->waiting[ROLE_UPGRADER];
+    switch (rw->priority) {
+    case READERS: return readers_waiting == 0;
+    case WRITERS: return true;
+    case N_WAY: return readers_waiting == 0 || rw->nway_count >= rw->n;
+    }
+    return false;
+}
+
+// Take the state word in the given role with a CAS, as long as the role may enter
+static bool try_take(rwlock_t *rw, role_t role, uint32_t state) {
+    while (may_enter(rw, role, state)) {
+        uint32_t next = role == ROLE_READER   ? state + 1
+                        : role == ROLE_WRITER ? state | WRITER
+                                              : state | UPGRADER;
+        if (atomic_compare_exchange_weak_explicit(
+                &(rw->state), &state, next, memory_order_acquire, memory_order_relaxed)) {
+            return true;
         }
+    }
+    return false;
+}
+
+// Keep the WAITING bit in step with the waiter counts (mutex held)
+static void update_waiting(rwlock_t *rw) {
+    if (rw->waiting[ROLE_READER] + rw->waiting[ROLE_UPGRADER] + writers_waiting(rw) > 0) {
+        atomic_fetch_or_explicit(&(rw->state), WAITING, memory_order_relaxed);
     } else {
-        fprintf(stderr, "Reader wait failed. Unknown priority.\n");
-        return -1;
-    }
-    return -1;
-}
-
-// Helper function that determines the number of active readers, active writers, or waiting readers based on the priority and the current state of the read-write lock
-int writer_wait(rwlock_t *rw) {
-    // If the priority is readers, returns the number of active readers
-    if (rw->priority == READERS) {
-        return rw->active_readers;
-    }
-    // If the priority is writers, returns the number of active writers
-    else if (rw->priority == WRITERS) {
-        return rw->active_writers;
-    }
-    // If priority is N_WAY, it considers the number of active readers, active writers, and a condition based on the flag
-    else if (rw->priority == N_WAY) {
-        if (rw->active_readers > 0) {
-            return rw->active_readers;
-        } else if (rw->active_writers) {
-            return rw->active_writers;
-        } else {
-            if (rw->flag == false) {
-                return rw->waiting_readers;
-            } else {
-                return 0;
+        atomic_fetch_and_explicit(&(rw->state), ~WAITING, memory_order_relaxed);
+    }
+}
+
+// Book-keeping once a thread has the lock (mutex held)
+static void entered(rwlock_t *rw, role_t role) {
+    if (role == ROLE_WRITER) {
+        // The writer has had its turn; the next waiting readers start a new batch (N_WAY)
+        rw->nway_count = 0;
+        rw->last_writer_at = rw->reads_admitted;
+        return;
+    }
+    rw->reads_admitted++;
+    if (writers_waiting(rw) > 0) {
+        // Count readers that got in ahead of a waiting writer (N_WAY)
+        rw->nway_count++;
+    }
+}
+
+// A writer that queued when reads_admitted was queued_at is getting the lock (mutex held).
+// Count the readers let in ahead of it since it queued, or since the previous writer's turn
+// if that came later. This is counted separately from nway_count, which enforces the bound,
+// so it shows whether the bound actually held.
+static void writer_granted(rwlock_t *rw, uint64_t queued_at) {
+    if (atomic_load_explicit(&(rw->stats_on), memory_order_relaxed)) {
+        uint64_t since = queued_at > rw->last_writer_at ? queued_at : rw->last_writer_at;
+        atomic_max(&(rw->max_reads_ahead), rw->reads_admitted - since);
+    }
+}
+
+// Wake the thread sleeping on a futex word (mutex held)
+static void wake(_Atomic uint32_t *seq) {
+    atomic_fetch_add_explicit(seq, 1, memory_order_relaxed);
+    futex_wake(seq, 1);
+}
+
+// Hand the lock to the oldest waiter of a role and wake it (mutex held). The waiter
+// takes the mutex before returning, so its node stays valid until we are done with it.
+static void grant(rwlock_t *rw, role_t role) {
+    waiter_t *w = rw->head[role];
+
+    rw->head[role] = w->next;
+    if (rw->head[role] == NULL) {
+        rw->tail[role] = NULL;
+    }
+    rw->waiting[role]--;
+    atomic_store_explicit(&(w->granted), 1, memory_order_relaxed);
+    futex_wake(&(w->granted), 1);
+}
+
+// Hand the lock to the waiters that may have it now and wake exactly those (mutex held).
+// An upgrading reader whose readers have drained goes first; then the oldest waiting readers
+// get the lock as one batch (at most the rest of the n under N_WAY) along with one
+// upgradable reader, or failing that the oldest writer gets it. The state word is updated
+// on the waiters' behalf, so a woken thread already holds the lock and no thread wakes only
+// to find it taken and go back to sleep.
+static void grant_waiters(rwlock_t *rw) {
+    uint32_t state = atomic_load_explicit(&(rw->state), memory_order_acquire);
+    bool granted = false;
+
+    if (rw->upgrading && !(state & READER_MASK)) {
+        wake(&(rw->upgrade_seq));
+        return;
+    }
+
+    // Only WAITING is set and cleared under the mutex, and it is set, so no fast path can
+    // change the bits checked here while the new holders are added to the word
+    if (rw->waiting[ROLE_READER] > 0 && may_enter(rw, ROLE_READER, state)) {
+        uint32_t batch = rw->waiting[ROLE_READER];
+        if (writers_waiting(rw) > 0) {
+            if (rw->priority == N_WAY && rw->n - rw->nway_count < batch) {
+                batch = rw->n - rw->nway_count;
             }
+            rw->nway_count += batch;
         }
+        rw->reads_admitted += batch;
+        state = atomic_fetch_add_explicit(&(rw->state), batch, memory_order_acq_rel) + batch;
+        for (uint32_t i = 0; i < batch; i++) {
+            grant(rw, ROLE_READER);
+        }
+        granted = true;
+    }
+    if (rw->waiting[ROLE_UPGRADER] > 0 && may_enter(rw, ROLE_UPGRADER, state)) {
+        atomic_fetch_or_explicit(&(rw->state), UPGRADER, memory_order_acq_rel);
+        entered(rw, ROLE_UPGRADER);
+        grant(rw, ROLE_UPGRADER);
+        granted = true;
+    }
+    if (!granted && rw->waiting[ROLE_WRITER] > 0 && may_enter(rw, ROLE_WRITER, state)) {
+        atomic_fetch_or_explicit(&(rw->state), WRITER, memory_order_acq_rel);
+        writer_granted(rw, rw->head[ROLE_WRITER]->queued_at);
+        entered(rw, ROLE_WRITER);
+        grant(rw, ROLE_WRITER);
+        granted = true;
+    }
+    if (granted) {
+        update_waiting(rw);
+    }
+}
+
+// Take a waiter that gave up out of its role's queue (mutex held)
+static void dequeue(rwlock_t *rw, role_t role, waiter_t *self) {
+    waiter_t **link = &(rw->head[role]);
+    waiter_t *prev = NULL;
+
+    while (*link != self) {
+        prev = *link;
+        link = &((*link)->next);
+    }
+    *link = self->next;
+    if (rw->tail[role] == self) {
+        rw->tail[role] = prev;
+    }
+    rw->waiting[role]--;
+}
+
+// Slow path of every acquire: queue up in the given role and sleep until the lock is handed
+// over. Gives up at the deadline, or at once if wait is false. Returns whether the lock was
+// taken.
+static bool lock_slow(rwlock_t *rw, role_t role, bool wait, const struct timespec *deadline) {
+    waiter_t self;
+
+    pthread_mutex_lock(&(rw->mutex));
+
+    // Take the lock directly only if no thread of the same role is queued ahead of us
+    if (rw->waiting[role] == 0
+        && try_take(rw, role, atomic_load_explicit(&(rw->state), memory_order_relaxed))) {
+        entered(rw, role);
+        pthread_mutex_unlock(&(rw->mutex));
+        return true;
+    }
+    if (!wait) {
+        pthread_mutex_unlock(&(rw->mutex));
+        return false;
+    }
+
+    uint64_t start = wait_begin();
+    atomic_init(&(self.granted), 0);
+    self.queued_at = rw->reads_admitted;
+    self.next = NULL;
+    if (rw->tail[role] == NULL) {
+        rw->head[role] = &self;
     } else {
-        fprintf(stderr, "Writer wait failed. Unknown priority.\n");
-        return -1;
+        rw->tail[role]->next = &self;
     }
+    rw->tail[role] = &self;
+    rw->waiting[role]++;
+    update_waiting(rw);
+
+    // A release that happened before WAITING was set didn't take the slow path, so catch up
+    // on it; any later release sees WAITING and hands the lock over itself
+    grant_waiters(rw);
+
+    while (!atomic_load_explicit(&(self.granted), memory_order_relaxed)) {
+        pthread_mutex_unlock(&(rw->mutex));
+        int timed_out = futex_wait(&(self.granted), 0, deadline);
+        pthread_mutex_lock(&(rw->mutex));
+
+        if (timed_out && !atomic_load_explicit(&(self.granted), memory_order_relaxed)) {
+            // Leaving the queue can let others in, e.g. readers held back by this writer
+            dequeue(rw, role, &self);
+            update_waiting(rw);
+            grant_waiters(rw);
+            pthread_mutex_unlock(&(rw->mutex));
+            wait_end(start);
+            return false;
+        }
+    }
+
+    pthread_mutex_unlock(&(rw->mutex));
+    wait_end(start);
+    return true;
 }
 
-// Acquires a reader lock in a reader-writer lock
-void reader_lock(rwlock_t *rw) {
-    // Acquire the mutex to ensure exclusive access to the shared resources in the rwlock
+// Slow path of every release: hand the lock to whoever the release let in
+static void unlock_slow(rwlock_t *rw) {
     pthread_mutex_lock(&(rw->mutex));
+    grant_waiters(rw);
+    pthread_mutex_unlock(&(rw->mutex));
+}
 
-    // Increment the count of waiting readers
-    rw->waiting_readers++;
+// Acquires the state word for reading
+static bool word_reader_lock(rwlock_t *rw, bool wait, const struct timespec *deadline) {
+    // Fast path: nobody holds it for writing and nobody is waiting
+    uint32_t state = atomic_load_explicit(&(rw->state), memory_order_relaxed);
+    while (!(state & (WRITER | WAITING))) {
+        if (atomic_compare_exchange_weak_explicit(
+                &(rw->state), &state, state + 1, memory_order_acquire, memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return lock_slow(rw, ROLE_READER, wait, deadline);
+}
+
+// Releases the state word for reading
+static void word_reader_unlock(rwlock_t *rw) {
+    uint32_t state = atomic_fetch_sub_explicit(&(rw->state), 1, memory_order_release);
+
+    // Readers never wait on readers, so only the last one out can have someone to wake
+    if ((state & WAITING) && (state & READER_MASK) == 1) {
+        unlock_slow(rw);
+    }
+}
 
-    // Wait until it is safe for the reader to proceed
-    while (reader_wait(rw)) {
-        pthread_cond_wait(&(rw->readers_cond), &(rw->mutex));
+// Acquires the state word for writing
+static bool word_writer_lock(rwlock_t *rw, bool wait, const struct timespec *deadline) {
+    // Fast path: the lock is completely free
+    uint32_t state = 0;
+    if (atomic_compare_exchange_strong_explicit(
+            &(rw->state), &state, WRITER, memory_order_acquire, memory_order_relaxed)) {
+        return true;
     }
+    return lock_slow(rw, ROLE_WRITER, wait, deadline);
+}
 
-    // Decrease the count of waiting readers and increase the count of active readers
-    rw->waiting_readers--;
-    rw->active_readers++;
+// Releases the state word for writing
+static void word_writer_unlock(rwlock_t *rw) {
+    uint32_t state = atomic_fetch_and_explicit(&(rw->state), ~WRITER, memory_order_release);
+    if (state & WAITING) {
+        unlock_slow(rw);
+    }
+}
 
-    // Check for priority and N_WAY flag for advanced reader-writer lock behavior
-    if (rw->priority == N_WAY) {
-        // If the flag is true and nway_count is 0, reset the flag to false
-        if (rw->flag == true && rw->nway_count == 0) {
-            rw->flag = false;
+// Acquires the state word as the upgradable reader
+static void word_upgradable_lock(rwlock_t *rw) {
+    // Fast path: no writer, no other upgradable reader and nobody waiting
+    uint32_t state = atomic_load_explicit(&(rw->state), memory_order_relaxed);
+    while (!(state & (WRITER | WAITING | UPGRADER))) {
+        if (atomic_compare_exchange_weak_explicit(&(rw->state), &state, state | UPGRADER,
+                memory_order_acquire, memory_order_relaxed)) {
+            return;
         }
+    }
+    lock_slow(rw, ROLE_UPGRADER, true, NULL);
+}
+
+// Releases the state word as the upgradable reader
+static void word_upgradable_unlock(rwlock_t *rw) {
+    uint32_t state = atomic_fetch_and_explicit(&(rw->state), ~UPGRADER, memory_order_release);
+    if (state & WAITING) {
+        unlock_slow(rw);
+    }
+}
+
+// Turns the upgradable reader into the writer once the plain readers have left. No writer
+// can get in meanwhile, because the UPGRADER bit keeps them out.
+static void word_upgrade(rwlock_t *rw) {
+    // Fast path: no readers and nobody waiting
+    uint32_t state = UPGRADER;
+    if (atomic_compare_exchange_strong_explicit(
+            &(rw->state), &state, WRITER, memory_order_acquire, memory_order_relaxed)) {
+        return;
+    }
 
-        // If the flag is false and nway_count is less than the total number of readers, increment nway_count
-        if (rw->flag == false && rw->nway_count < rw->n) {
-            rw->nway_count++;
+    // Slow path: count as a waiting writer, so the priority rules hold back new readers,
+    // and sleep until the last reader leaves
+    uint64_t start = wait_begin();
+    pthread_mutex_lock(&(rw->mutex));
+    uint64_t queued_at = rw->reads_admitted;
+    rw->upgrading = true;
+    update_waiting(rw);
+
+    for (;;) {
+        state = atomic_load_explicit(&(rw->state), memory_order_relaxed);
+        if (!(state & READER_MASK)) {
+            // New readers queue behind WAITING, so only the WAITING bit can still change
+            while (!atomic_compare_exchange_weak_explicit(&(rw->state), &state,
+                (state & ~UPGRADER) | WRITER, memory_order_acquire, memory_order_relaxed)) {
+            }
+            break;
         }
+        uint32_t seq = atomic_load_explicit(&(rw->upgrade_seq), memory_order_relaxed);
+        pthread_mutex_unlock(&(rw->mutex));
+        futex_wait(&(rw->upgrade_seq), seq, NULL);
+        pthread_mutex_lock(&(rw->mutex));
     }
 
-    // Release the mutex, allowing other threads to acquire the lock
+    rw->upgrading = false;
+    writer_granted(rw, queued_at);
+    entered(rw, ROLE_WRITER);
+    update_waiting(rw);
     pthread_mutex_unlock(&(rw->mutex));
+    wait_end(start);
 }
 
-// Releases a reader lock in a reader-writer lock
-void reader_unlock(rwlock_t *rw) {
-    // Acquire the mutex to ensure exclusive access to the shared resources in the rwlock
-    pthread_mutex_lock(&(rw->mutex));
+// The calling thread's reader slot in a big-reader lock
+static reader_slot_t *my_slot(rwlock_t *rw) {
+    if (slot_index < 0) {
+        slot_index = atomic_fetch_add_explicit(&next_slot_index, 1, memory_order_relaxed);
+    }
+    return &(rw->slots[slot_index % rw->nslots]);
+}
+
+// Leave a reader slot, waking the writer if it is waiting for the slots to drain. The
+// seq_cst operations pair with the writer's, so either it sees our decrement or we see it.
+static void slot_leave(rwlock_t *rw, reader_slot_t *slot) {
+    atomic_fetch_sub_explicit(&(slot->readers), 1, memory_order_seq_cst);
+    if (atomic_load_explicit(&(rw->writers_pending), memory_order_seq_cst)) {
+        atomic_fetch_add_explicit(&(rw->drain_seq), 1, memory_order_release);
+        futex_wake(&(rw->drain_seq), 1);
+    }
+}
 
-    // Decrease the count of active readers
-    rw->active_readers--;
+// Big-reader lock: a reader only touches its own slot unless a writer is pending
+static bool big_reader_lock(rwlock_t *rw, bool wait, const struct timespec *deadline) {
+    reader_slot_t *slot = my_slot(rw);
 
-    // Check for priority and N_WAY flag for advanced reader-writer lock behavior
-    if (rw->priority == N_WAY) {
-        // If nway_count equals the total number of readers, set the flag to true
-        if (rw->nway_count == rw->n) {
-            rw->flag = true;
-        }
-        // If the flag is true and nway_count is greater than 0, reset nway_count to 0
-        if (rw->flag == true && rw->nway_count > 0) {
-            rw->nway_count = 0;
+    // Fast path: announce ourselves in our slot, then make sure no writer got in first
+    atomic_fetch_add_explicit(&(slot->readers), 1, memory_order_seq_cst);
+    if (!atomic_load_explicit(&(rw->writers_pending), memory_order_seq_cst)) {
+        return true;
+    }
+
+    // A writer holds or is queued for the lock: back out so it can drain, then queue on the
+    // state word, where the lock's priority decides when this reader gets in relative to
+    // every queued writer. A writer only drains while it holds the state word, so once we
+    // hold it for reading we can take our slot.
+    slot_leave(rw, slot);
+    if (!word_reader_lock(rw, wait, deadline)) {
+        return false;
+    }
+    atomic_fetch_add_explicit(&(slot->readers), 1, memory_order_seq_cst);
+    word_reader_unlock(rw);
+    return true;
+}
+
+// Count a writer as pending, which sends new readers to the state word. It stays counted
+// from before it queues until it unlocks, including the handoff from one writer to the
+// next, so readers can't slip in through the fast path between two queued writers.
+static void big_writer_enter(rwlock_t *rw) {
+    atomic_fetch_add_explicit(&(rw->writers_pending), 1, memory_order_seq_cst);
+}
+
+// Stop counting a writer as pending; once none are left readers use their slots again
+static void big_writer_leave(rwlock_t *rw) {
+    atomic_fetch_sub_explicit(&(rw->writers_pending), 1, memory_order_release);
+}
+
+// Big-reader writer, once it is pending and holds the state word: wait for every reader
+// slot to drain. Returns false on timeout.
+static bool big_writer_drain(rwlock_t *rw, const struct timespec *deadline) {
+    uint64_t start = 0;
+
+    for (uint32_t i = 0; i < rw->nslots; i++) {
+        for (;;) {
+            uint32_t seq = atomic_load_explicit(&(rw->drain_seq), memory_order_acquire);
+            if (atomic_load_explicit(&(rw->slots[i].readers), memory_order_seq_cst) == 0) {
+                break;
+            }
+            if (start == 0) {
+                start = wait_begin();
+            }
+            if (futex_wait(&(rw->drain_seq), seq, deadline)) {
+                wait_end(start);
+                return false;
+            }
         }
     }
+    wait_end(start);
+    return true;
+}
 
-    // Wake up all waiting readers
-    pthread_cond_broadcast(&(rw->readers_cond));
-    // Wake up all waiting writers
-    pthread_cond_broadcast(&(rw->writers_cond));
+// Big-reader writer: take the state word to order against other writers and queued readers,
+// then drain the reader slots
+static bool big_writer_lock(rwlock_t *rw, bool wait, const struct timespec *deadline) {
+    big_writer_enter(rw);
+    if (!word_writer_lock(rw, wait, deadline)) {
+        big_writer_leave(rw);
+        return false;
+    }
 
-    // Release the mutex, allowing other threads to acquire the lock
-    pthread_mutex_unlock(&(rw->mutex));
+    // A writer that may not wait gives up if any reader is in, rather than draining
+    struct timespec no_wait = { 0, 0 };
+    if (!big_writer_drain(rw, wait ? deadline : &no_wait)) {
+        big_writer_leave(rw);
+        word_writer_unlock(rw);
+        return false;
+    }
+    return true;
+}
+
+// Big-reader writer release: stop counting as pending, which lets fast-path readers back in
+// unless another writer is still queued, then hand the state word on
+static void big_writer_unlock(rwlock_t *rw) {
+    big_writer_leave(rw);
+    word_writer_unlock(rw);
+}
+
+// Acquires a reader lock in a reader-writer lock
+void reader_lock(rwlock_t *rw) {
+    if (rw->mode == RWLOCK_BIG_READER) {
+        big_reader_lock(rw, true, NULL);
+    } else {
+        word_reader_lock(rw, true, NULL);
+    }
+    stats_acquired(rw, false, true);
+}
+
+// Releases a reader lock in a reader-writer lock
+void reader_unlock(rwlock_t *rw) {
+    if (rw->mode == RWLOCK_BIG_READER) {
+        slot_leave(rw, my_slot(rw));
+    } else {
+        word_reader_unlock(rw);
+    }
 }
 
 // Acquires a writer lock in a reader-writer lock
 void writer_lock(rwlock_t *rw) {
-    // Acquire the mutex to ensure exclusive access to the shared resources in the rwlock
-    pthread_mutex_lock(&(rw->mutex));
+    if (rw->mode == RWLOCK_BIG_READER) {
+        big_writer_lock(rw, true, NULL);
+    } else {
+        word_writer_lock(rw, true, NULL);
+    }
+    stats_acquired(rw, true, true);
+}
+
+// Releases a writer lock in a reader-writer lock
+void writer_unlock(rwlock_t *rw) {
+    if (rw->mode == RWLOCK_BIG_READER) {
+        big_writer_unlock(rw);
+    } else {
+        word_writer_unlock(rw);
+    }
+}
 
-    // Increment the count of waiting writers
-    rw->waiting_writers++;
+// Acquires a reader lock only if that can be done without waiting
+bool reader_trylock(rwlock_t *rw) {
+    bool acquired;
 
-    // Wait until it is safe for the writer to proceed
-    while (writer_wait(rw)) {
-        pthread_cond_wait(&(rw->writers_cond), &(rw->mutex));
+    if (rw->mode == RWLOCK_BIG_READER) {
+        acquired = big_reader_lock(rw, false, NULL);
+    } else {
+        acquired = word_reader_lock(rw, false, NULL);
     }
+    return stats_acquired(rw, false, acquired);
+}
 
-    // Decrease the count of waiting writers and increase the count of active writers
-    rw->waiting_writers--;
-    rw->active_writers++;
+// Acquires a writer lock only if that can be done without waiting
+bool writer_trylock(rwlock_t *rw) {
+    bool acquired;
 
-    // Release the mutex, allowing other threads to acquire the lock
-    pthread_mutex_unlock(&(rw->mutex));
+    if (rw->mode == RWLOCK_BIG_READER) {
+        acquired = big_writer_lock(rw, false, NULL);
+    } else {
+        acquired = word_writer_lock(rw, false, NULL);
+    }
+    return stats_acquired(rw, true, acquired);
 }
 
-// Releases a writer lock in a reader-writer lock
-void writer_unlock(rwlock_t *rw) {
-    // Acquire the mutex to ensure exclusive access to the shared resources in the rwlock
-    pthread_mutex_lock(&(rw->mutex));
+// Acquires a reader lock, giving up at the deadline
+bool reader_timedlock(rwlock_t *rw, const struct timespec *deadline) {
+    bool acquired;
 
-    // Decrease the count of active writers
-    rw->active_writers--;
+    if (rw->mode == RWLOCK_BIG_READER) {
+        acquired = big_reader_lock(rw, true, deadline);
+    } else {
+        acquired = word_reader_lock(rw, true, deadline);
+    }
+    return stats_acquired(rw, false, acquired);
+}
 
-    // Check for priority and N_WAY flag for advanced reader-writer lock behavior
-    if (rw->priority == N_WAY) {
-        // If the flag is true, reset it to false
-        if (rw->flag == true) {
-            rw->flag = false;
-        }
+// Acquires a writer lock, giving up at the deadline
+bool writer_timedlock(rwlock_t *rw, const struct timespec *deadline) {
+    bool acquired;
+
+    if (rw->mode == RWLOCK_BIG_READER) {
+        acquired = big_writer_lock(rw, true, deadline);
+    } else {
+        acquired = word_writer_lock(rw, true, deadline);
     }
+    return stats_acquired(rw, true, acquired);
+}
 
-    // Wake up all waiting readers
-    pthread_cond_broadcast(&(rw->readers_cond));
-    // Wake up all waiting writers
-    pthread_cond_broadcast(&(rw->writers_cond));
+// Acquires the lock as the upgradable reader. In big-reader mode the UPGRADER bit already
+// keeps writers out, so the upgradable reader doesn't need a reader slot.
+void upgradable_lock(rwlock_t *rw) {
+    word_upgradable_lock(rw);
+    stats_acquired(rw, false, true);
+}
 
-    // Release the mutex, allowing other threads to acquire the lock
-    pthread_mutex_unlock(&(rw->mutex));
+// Releases the lock as the upgradable reader
+void upgradable_unlock(rwlock_t *rw) {
+    word_upgradable_unlock(rw);
+}
+
+// Turns the upgradable reader into the writer; it then releases with writer_unlock()
+void upgradable_upgrade(rwlock_t *rw) {
+    if (rw->mode == RWLOCK_BIG_READER) {
+        big_writer_enter(rw);
+    }
+    word_upgrade(rw);
+    if (rw->mode == RWLOCK_BIG_READER) {
+        big_writer_drain(rw, NULL);
+    }
+    stats_acquired(rw, true, true);
+}
+
+// Turn statistics on or off
+void rwlock_stats_enable(rwlock_t *rw, bool enable) {
+    if (rw != NULL) {
+        atomic_store_explicit(&(rw->stats_on), enable, memory_order_relaxed);
+    }
+}
+
+// How long the calling thread's last acquisition attempt slept
+uint64_t rwlock_last_wait_ns(void) {
+    return last_wait_ns;
+}
+
+// Copy the statistics
+void rwlock_get_stats(rwlock_t *rw, rwlock_stats_t *stats) {
+    if (rw == NULL || stats == NULL) {
+        return;
+    }
+
+    stats->reads = atomic_load_explicit(&(rw->read_stats.count), memory_order_relaxed);
+    stats->read_waits = atomic_load_explicit(&(rw->read_stats.waits), memory_order_relaxed);
+    stats->read_wait_ns = atomic_load_explicit(&(rw->read_stats.wait_ns), memory_order_relaxed);
+    stats->read_max_wait_ns
+        = atomic_load_explicit(&(rw->read_stats.max_wait_ns), memory_order_relaxed);
+    stats->writes = atomic_load_explicit(&(rw->write_stats.count), memory_order_relaxed);
+    stats->write_waits = atomic_load_explicit(&(rw->write_stats.waits), memory_order_relaxed);
+    stats->write_wait_ns
+        = atomic_load_explicit(&(rw->write_stats.wait_ns), memory_order_relaxed);
+    stats->write_max_wait_ns
+        = atomic_load_explicit(&(rw->write_stats.max_wait_ns), memory_order_relaxed);
+    stats->max_reads_ahead = atomic_load_explicit(&(rw->max_reads_ahead), memory_order_relaxed);
 }
@@ -8,7 +8,9 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <time.h>
 
 /** @struct rwlock_t
  *
@@ -18,8 +20,55 @@
  */
 typedef struct rwlock rwlock_t;
 
+/** @brief Which waiting threads an rwlock lets in first.
+ *
+ *  READERS: readers enter whenever no writer holds the lock, and a
+ *  writer waits until no reader holds or is waiting for it.
+ *
+ *  WRITERS: once a writer is waiting, new readers wait until no writer
+ *  holds or is waiting for the lock.
+ *
+ *  N_WAY: once a writer is waiting, at most n more readers are let in
+ *  before the writer gets its turn; then the next n waiting readers go
+ *  before the next writer, and so on.
+ */
 typedef enum { READERS, WRITERS, N_WAY } PRIORITY;
 
+/** @brief How an rwlock is implemented.
+ *
+ *  RWLOCK_DEFAULT: one shared state word; every acquire and release is a
+ *  single atomic operation on it when nobody is waiting.
+ *
+ *  RWLOCK_BIG_READER: for read-mostly locks. Each reader only writes to
+ *  a per-thread slot on its own cache line, so readers on different
+ *  cores never contend. A writer has to flag the lock and wait for every
+ *  slot to drain, which makes writes more expensive. A writer that is
+ *  draining always goes before readers that arrive after it; the lock's
+ *  priority orders the threads queued behind it.
+ */
+typedef enum { RWLOCK_DEFAULT, RWLOCK_BIG_READER } RWLOCK_MODE;
+
+/** @brief A snapshot of an rwlock's statistics, see rwlock_stats_enable().
+ *
+ *  Upgradable locks count as reads and upgrades as writes. A wait is an
+ *  attempt that had to sleep for the lock, including timed attempts that
+ *  gave up. Readers let in ahead of a writer are counted from when it
+ *  queued, or from the previous writer's turn if that came later, so
+ *  under N_WAY max_reads_ahead never exceeds n and under WRITERS it
+ *  stays 0.
+ */
+typedef struct rwlock_stats {
+    uint64_t reads; // Read acquisitions
+    uint64_t read_waits; // Read attempts that had to wait
+    uint64_t read_wait_ns; // Total time read attempts spent waiting
+    uint64_t read_max_wait_ns; // Longest wait of a single read attempt
+    uint64_t writes; // Write acquisitions
+    uint64_t write_waits; // Write attempts that had to wait
+    uint64_t write_wait_ns; // Total time write attempts spent waiting
+    uint64_t write_max_wait_ns; // Longest wait of a single write attempt
+    uint64_t max_reads_ahead; // Most readers let in ahead of one queued writer
+} rwlock_stats_t;
+
 /** @brief Dynamically allocates and initializes a new rwlock with
  *         priority p, and, if using N_WAY priority, n.
  *
@@ -32,6 +81,19 @@ typedef enum { READERS, WRITERS, N_WAY } PRIORITY;
 
 rwlock_t *rwlock_new(PRIORITY p, uint32_t n);
 
+/** @brief Dynamically allocates and initializes a new rwlock like
+ *         rwlock_new, with the given implementation.
+ *
+ *  @param p the priority of the rwlock
+ *
+ *  @param n the n value, if using N_WAY priority
+ *
+ *  @param mode RWLOCK_DEFAULT or RWLOCK_BIG_READER
+ *
+ *  @return a pointer to a new rwlock_t
+ */
+rwlock_t *rwlock_new_mode(PRIORITY p, uint32_t n, RWLOCK_MODE mode);
+
 /** @brief Delete your rwlock and free all of its memory.
  *
  *  @param rw the rwlock to be deleted.  Note, you should assign the
@@ -62,3 +124,93 @@ void writer_lock(rwlock_t *rw);
  *
  */
 void writer_unlock(rwlock_t *rw);
+
+/** @brief acquire rw for reading only if that can be done without
+ *         waiting.
+ *
+ *  @return true if the lock was acquired.
+ */
+bool reader_trylock(rwlock_t *rw);
+
+/** @brief acquire rw for writing only if that can be done without
+ *         waiting.
+ *
+ *  @return true if the lock was acquired.
+ */
+bool writer_trylock(rwlock_t *rw);
+
+/** @brief acquire rw for reading, giving up at the deadline.
+ *
+ *  @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL
+ *  to wait forever.
+ *
+ *  @return true if the lock was acquired, false on timeout.
+ */
+bool reader_timedlock(rwlock_t *rw, const struct timespec *deadline);
+
+/** @brief acquire rw for writing, giving up at the deadline.
+ *
+ *  @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL
+ *  to wait forever.
+ *
+ *  @return true if the lock was acquired, false on timeout.
+ */
+bool writer_timedlock(rwlock_t *rw, const struct timespec *deadline);
+
+/** @brief acquire rw as the upgradable reader.
+ *
+ *  The upgradable reader shares the lock with plain readers but keeps
+ *  out writers and any other upgradable reader, so what it has read
+ *  stays true until it either releases the lock with
+ *  upgradable_unlock() or upgrades with upgradable_upgrade(). It waits
+ *  its turn like a reader under the lock's priority.
+ */
+void upgradable_lock(rwlock_t *rw);
+
+/** @brief release rw as the upgradable reader--you can assume that the
+ * thread has *already* acquired it with upgradable_lock() and has not
+ * upgraded.
+ *
+ */
+void upgradable_unlock(rwlock_t *rw);
+
+/** @brief atomically turn the upgradable reader into the writer.
+ *
+ *  Waits for the plain readers to leave, holding back new ones as a
+ *  waiting writer would under the lock's priority. No other writer can
+ *  get in between. The lock is then released with writer_unlock().
+ */
+void upgradable_upgrade(rwlock_t *rw);
+
+/** @brief Turn statistics on or off for an rwlock. They are off when
+ *         the lock is created, and cost one predictable branch per
+ *         acquisition while off. While on, every acquisition updates
+ *         shared counters, which defeats the point of big-reader mode.
+ *
+ *  @param rw the rwlock.
+ *
+ *  @param enable whether to collect statistics.
+ */
+void rwlock_stats_enable(rwlock_t *rw, bool enable);
+
+/** @brief Copy an rwlock's statistics, counted while they were enabled.
+ *
+ *  @param rw the rwlock.
+ *
+ *  @param stats a place to store the snapshot. Each counter is read
+ *  atomically, but not all of them at the same instant.
+ */
+void rwlock_get_stats(rwlock_t *rw, rwlock_stats_t *stats);
+
+/** @brief How long the calling thread slept in its last acquisition
+ *         attempt on any rwlock.
+ *
+ *  Only the slow paths read the clock, right before they may sleep, and
+ *  this needs no statistics, so a caller can keep its own per-thread
+ *  wait times without touching shared counters or reading the clock
+ *  around every acquisition.
+ *
+ *  @return the nanoseconds the attempt slept, 0 if it took the lock
+ *  without sleeping.
+ */
+uint64_t rwlock_last_wait_ns(void);
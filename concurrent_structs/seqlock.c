@@ -0,0 +1,89 @@
+// Main File - seqlock.c
+// Ishika Pol - CSE130
+// Implementation of a sequence lock whose readers only load the sequence number.
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "seqlock.h"
+
+#define CACHE_LINE_SIZE 64
+// Times a reader re-checks an odd sequence number before yielding to the writer
+#define READ_SPINS 64
+
+typedef struct seqlock {
+    // Odd while a writer is updating the record. Alone on its cache line, so readers only
+    // miss in cache when a write has actually happened.
+    alignas(CACHE_LINE_SIZE) _Atomic uint32_t seq;
+    // Serializes writers. On the next line, so writers queueing on it don't dirty seq's.
+    alignas(CACHE_LINE_SIZE) pthread_mutex_t mutex;
+} seqlock_t;
+
+// Create a new seqlock
+seqlock_t *seqlock_new(void) {
+    seqlock_t *s = aligned_alloc(CACHE_LINE_SIZE, sizeof(seqlock_t));
+    if (s == NULL) {
+        fprintf(stderr, "Failed to allocate memory for seqlock.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    atomic_init(&(s->seq), 0);
+    pthread_mutex_init(&(s->mutex), NULL);
+    return s;
+}
+
+// Delete the seqlock
+void seqlock_delete(seqlock_t **s) {
+    if (s == NULL || *s == NULL) {
+        return;
+    }
+
+    pthread_mutex_destroy(&((*s)->mutex));
+    free(*s);
+    *s = NULL;
+}
+
+// Make the sequence number odd before any of the writer's stores to the record
+void seqlock_write_begin(seqlock_t *s) {
+    pthread_mutex_lock(&(s->mutex));
+
+    uint32_t seq = atomic_load_explicit(&(s->seq), memory_order_relaxed);
+    atomic_store_explicit(&(s->seq), seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+// Make the sequence number even again after all of the writer's stores to the record
+void seqlock_write_end(seqlock_t *s) {
+    uint32_t seq = atomic_load_explicit(&(s->seq), memory_order_relaxed);
+    atomic_store_explicit(&(s->seq), seq + 1, memory_order_release);
+
+    pthread_mutex_unlock(&(s->mutex));
+}
+
+// Wait for an even sequence number; the acquire keeps the record loads after it
+uint32_t seqlock_read_begin(seqlock_t *s) {
+    int spins = 0;
+
+    for (;;) {
+        uint32_t seq = atomic_load_explicit(&(s->seq), memory_order_acquire);
+        if ((seq & 1) == 0) {
+            return seq;
+        }
+        // Writes are short, but the writer may have been preempted mid-update
+        if (++spins == READ_SPINS) {
+            spins = 0;
+            sched_yield();
+        }
+    }
+}
+
+// The fence keeps the record loads before the second look at the sequence number
+bool seqlock_read_retry(seqlock_t *s, uint32_t start) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&(s->seq), memory_order_relaxed) != start;
+}
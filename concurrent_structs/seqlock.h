@@ -0,0 +1,80 @@
+/**
+ * @File seqlock.h
+ *
+ * A sequence lock for small records that are read far more often than
+ * they are written, such as a cached file's size and mtime. Readers
+ * never write shared memory: they note the sequence number, copy the
+ * record, and retry if a writer was active in the meantime. Writers
+ * exclude each other with a mutex and make the sequence number odd
+ * while they update the record.
+ *
+ * Readers can see a record while it is being written, so every field it
+ * protects must be an _Atomic type, accessed with memory_order_relaxed
+ * loads and stores; the seqlock supplies the ordering. A reader must
+ * not follow pointers it read before seqlock_read_retry() has said the
+ * copy is consistent.
+ *
+ *      do {
+ *          start = seqlock_read_begin(s);
+ *          size = atomic_load_explicit(&(record->size), memory_order_relaxed);
+ *          mtime = atomic_load_explicit(&(record->mtime), memory_order_relaxed);
+ *      } while (seqlock_read_retry(s, start));
+ *
+ * @author Ishika Pol
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @struct seqlock_t
+ *
+ *  @brief This typedef renames the struct seqlock.
+ */
+typedef struct seqlock seqlock_t;
+
+/** @brief Dynamically allocates and initializes a new seqlock.
+ *
+ *  @return a pointer to a new seqlock_t
+ */
+seqlock_t *seqlock_new(void);
+
+/** @brief Delete a seqlock and free all of its memory.
+ *
+ *  @param s the seqlock to be deleted. *s is set to NULL on return.
+ */
+void seqlock_delete(seqlock_t **s);
+
+/** @brief Start updating the record, waiting for any other writer to
+ *         finish first.
+ *
+ *  @param s the seqlock.
+ */
+void seqlock_write_begin(seqlock_t *s);
+
+/** @brief Finish updating the record--you can assume that the thread
+ *  calling this has *already* called seqlock_write_begin().
+ *
+ *  @param s the seqlock.
+ */
+void seqlock_write_end(seqlock_t *s);
+
+/** @brief Start reading the record, spinning while a writer is active.
+ *
+ *  @param s the seqlock.
+ *
+ *  @return the sequence number to pass to seqlock_read_retry().
+ */
+uint32_t seqlock_read_begin(seqlock_t *s);
+
+/** @brief Check whether the record read since seqlock_read_begin() may
+ *         be inconsistent.
+ *
+ *  @param s the seqlock.
+ *
+ *  @param start what seqlock_read_begin() returned.
+ *
+ *  @return true if a writer got in and the read must be repeated.
+ */
+bool seqlock_read_retry(seqlock_t *s, uint32_t start);
@@ -0,0 +1,174 @@
+// Main File - spsc.c
+// Ishika Pol - CSE130
+// Implementation of a bounded single-producer/single-consumer ring buffer using only acquire/release atomics.
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "futex.h"
+#include "spsc.h"
+
+#define CACHE_LINE_SIZE 64
+
+typedef struct spsc {
+    // Read-only after spsc_new()
+    alignas(CACHE_LINE_SIZE) size_t mask; // Capacity - 1 (capacity is a power of two)
+    void **buffer; // The ring of elements
+
+    // Written only by the producer. cached_head is the producer's last look at head, so
+    // it only has to read the consumer's cache line when the ring seems full.
+    alignas(CACHE_LINE_SIZE) _Atomic size_t tail; // Next position to push into
+    size_t cached_head; // Producer's copy of head
+    _Atomic uint32_t producer_seq; // Futex word the producer sleeps on while full
+    _Atomic uint32_t producer_waiting; // Set while the producer is about to sleep
+
+    // Written only by the consumer, with the same trick for tail
+    alignas(CACHE_LINE_SIZE) _Atomic size_t head; // Next position to pop from
+    size_t cached_tail; // Consumer's copy of tail
+    _Atomic uint32_t consumer_seq; // Futex word the consumer sleeps on while empty
+    _Atomic uint32_t consumer_waiting; // Set while the consumer is about to sleep
+} spsc_t;
+
+// Create a new queue with the specified size
+spsc_t *spsc_new(int size) {
+    // Round the capacity up to a power of two so positions map to slots with a mask
+    size_t capacity = 1;
+    while (capacity < (size_t) size) {
+        capacity <<= 1;
+    }
+
+    spsc_t *q = aligned_alloc(CACHE_LINE_SIZE, sizeof(spsc_t));
+    void **buffer = malloc(sizeof(void *) * capacity);
+    if (q == NULL || buffer == NULL) {
+        fprintf(stderr, "Failed to allocate memory for spsc queue.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    q->mask = capacity - 1;
+    q->buffer = buffer;
+    atomic_init(&(q->tail), 0);
+    q->cached_head = 0;
+    atomic_init(&(q->producer_seq), 0);
+    atomic_init(&(q->producer_waiting), 0);
+    atomic_init(&(q->head), 0);
+    q->cached_tail = 0;
+    atomic_init(&(q->consumer_seq), 0);
+    atomic_init(&(q->consumer_waiting), 0);
+
+    return q;
+}
+
+// Delete the queue and release associated resources
+void spsc_delete(spsc_t **q) {
+    if (q == NULL || *q == NULL) {
+        return;
+    }
+    free((*q)->buffer);
+    free(*q);
+    *q = NULL;
+}
+
+// Wake the other side if it said it was going to sleep. The fence pairs with the one in
+// spsc_push() and spsc_pop(), so either the sleeper sees our update or we see its flag.
+static void spsc_wake(_Atomic uint32_t *waiting, _Atomic uint32_t *seq) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(waiting, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(seq, 1, memory_order_release);
+        futex_wake(seq, 1);
+    }
+}
+
+// Push an element only if there is a free slot right now
+bool spsc_try_push(spsc_t *q, void *element) {
+    if (q == NULL) {
+        return false;
+    }
+
+    size_t tail = atomic_load_explicit(&(q->tail), memory_order_relaxed);
+    if (tail - q->cached_head > q->mask) {
+        // Looks full; refresh our copy of head before giving up
+        q->cached_head = atomic_load_explicit(&(q->head), memory_order_acquire);
+        if (tail - q->cached_head > q->mask) {
+            return false;
+        }
+    }
+
+    // Store the element, then publish it by moving tail past it
+    q->buffer[tail & q->mask] = element;
+    atomic_store_explicit(&(q->tail), tail + 1, memory_order_release);
+    return true;
+}
+
+// Pop an element only if one is available right now
+bool spsc_try_pop(spsc_t *q, void **element) {
+    if (q == NULL) {
+        return false;
+    }
+
+    size_t head = atomic_load_explicit(&(q->head), memory_order_relaxed);
+    if (head == q->cached_tail) {
+        // Looks empty; refresh our copy of tail before giving up
+        q->cached_tail = atomic_load_explicit(&(q->tail), memory_order_acquire);
+        if (head == q->cached_tail) {
+            return false;
+        }
+    }
+
+    // Take the element, then hand its slot back by moving head past it
+    *element = q->buffer[head & q->mask];
+    atomic_store_explicit(&(q->head), head + 1, memory_order_release);
+    return true;
+}
+
+// Push an element onto the queue, sleeping while it is full
+bool spsc_push(spsc_t *q, void *element) {
+    if (q == NULL) {
+        return false;
+    }
+
+    while (!spsc_try_push(q, element)) {
+        // Announce that we are going to sleep, then check again so a pop that happened in
+        // between can't be missed
+        atomic_store_explicit(&(q->producer_waiting), 1, memory_order_relaxed);
+        uint32_t seq = atomic_load_explicit(&(q->producer_seq), memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&(q->tail), memory_order_relaxed)
+                - atomic_load_explicit(&(q->head), memory_order_acquire)
+            > q->mask) {
+            futex_wait(&(q->producer_seq), seq, NULL);
+        }
+        atomic_store_explicit(&(q->producer_waiting), 0, memory_order_relaxed);
+    }
+
+    // Signal that an element is available
+    spsc_wake(&(q->consumer_waiting), &(q->consumer_seq));
+    return true;
+}
+
+// Pop an element from the queue, sleeping while it is empty
+bool spsc_pop(spsc_t *q, void **element) {
+    if (q == NULL) {
+        return false;
+    }
+
+    while (!spsc_try_pop(q, element)) {
+        // Announce that we are going to sleep, then check again so a push that happened in
+        // between can't be missed
+        atomic_store_explicit(&(q->consumer_waiting), 1, memory_order_relaxed);
+        uint32_t seq = atomic_load_explicit(&(q->consumer_seq), memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&(q->head), memory_order_relaxed)
+            == atomic_load_explicit(&(q->tail), memory_order_acquire)) {
+            futex_wait(&(q->consumer_seq), seq, NULL);
+        }
+        atomic_store_explicit(&(q->consumer_waiting), 0, memory_order_relaxed);
+    }
+
+    // Signal that a slot is free
+    spsc_wake(&(q->producer_waiting), &(q->producer_seq));
+    return true;
+}
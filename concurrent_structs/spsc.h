@@ -0,0 +1,95 @@
+/**
+ * @File spsc.h
+ *
+ * A bounded queue for exactly one producer thread and one consumer
+ * thread. It holds the same elements as queue_t (void *) but needs no
+ * read-modify-write atomics: each side only loads the other's index and
+ * stores its own.
+ *
+ * Blocking is optional. spsc_try_push and spsc_try_pop are plain
+ * acquire/release operations that never sleep and never wake the other
+ * side, for pipelines that poll. spsc_push and spsc_pop sleep on a futex
+ * while the queue is full or empty and wake a sleeping peer, at the cost
+ * of a full fence per call. A thread that sleeps in spsc_pop must be fed
+ * with spsc_push, and a thread that sleeps in spsc_push must be drained
+ * with spsc_pop.
+ *
+ * @author Ishika Pol
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/** @struct spsc_t
+ *
+ *  @brief This typedef renames the struct spsc. At most one thread may
+ *  push and at most one thread may pop at any time.
+ */
+typedef struct spsc spsc_t;
+
+/** @brief Dynamically allocates and initializes a new single-producer,
+ *         single-consumer queue that holds at least size elements.
+ *
+ *  @param size the maximum size of the queue; it is rounded up to a
+ *         power of two.
+ *
+ *  @return a pointer to a new spsc_t
+ */
+spsc_t *spsc_new(int size);
+
+/** @brief Delete a queue and free all of its memory.
+ *
+ *  @param q the queue to be deleted. *q is set to NULL on return.
+ */
+void spsc_delete(spsc_t **q);
+
+/** @brief push an element, sleeping while the queue is full.
+ *
+ *  Must only be called from the producer thread.
+ *
+ *  @param q the queue to push an element into.
+ *
+ *  @param elem the element to add to the queue
+ *
+ *  @return true unless q is NULL.
+ */
+bool spsc_push(spsc_t *q, void *elem);
+
+/** @brief pop an element, sleeping while the queue is empty.
+ *
+ *  Must only be called from the consumer thread.
+ *
+ *  @param q the queue to pop an element from.
+ *
+ *  @param elem a place to assign the popped element.
+ *
+ *  @return true unless q is NULL.
+ */
+bool spsc_pop(spsc_t *q, void **elem);
+
+/** @brief push an element without blocking.
+ *
+ *  Must only be called from the producer thread.
+ *
+ *  @param q the queue to push an element into.
+ *
+ *  @param elem the element to add to the queue
+ *
+ *  @return true if the element was added, false if the queue was full.
+ */
+bool spsc_try_push(spsc_t *q, void *elem);
+
+/** @brief pop an element without blocking.
+ *
+ *  Must only be called from the consumer thread.
+ *
+ *  @param q the queue to pop an element from.
+ *
+ *  @param elem a place to assign the popped element.
+ *
+ *  @return true if an element was popped, false if the queue was empty.
+ */
+bool spsc_try_pop(spsc_t *q, void **elem);
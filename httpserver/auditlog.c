@@ -0,0 +1,355 @@
+// Main File - auditlog.c
+// Ishika Pol - CSE130
+// Asynchronous audit log: per-thread lock-free rings, written in stamp order by a flusher thread.
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "auditlog.h"
+#include "futex.h"
+#include "helper_funcs.h"
+
+#define CACHE_LINE_SIZE 64
+// Entries in each thread's ring; a thread whose ring is full waits for the flusher
+#define RING_SIZE 512
+// How often the flusher drains the rings when no ring fills up sooner
+#define FLUSH_INTERVAL_NS 10000000
+// Bytes of log lines the flusher collects before each write()
+#define OUTPUT_SIZE 65536
+// Longest field values kept; request.c allows no longer methods or URIs
+#define MAX_METHOD_LENGTH 8
+#define MAX_URI_LENGTH 64
+#define MAX_ID_LENGTH 128
+// Longest possible line: the fields, the separators, "/", the status and "\n"
+#define MAX_LINE_LENGTH (MAX_METHOD_LENGTH + MAX_URI_LENGTH + MAX_ID_LENGTH + 32)
+
+typedef struct entry {
+    uint64_t stamp; // Position of the entry in the log
+    int status;
+    char method[MAX_METHOD_LENGTH + 1];
+    char uri[MAX_URI_LENGTH + 1];
+    char request_id[MAX_ID_LENGTH + 1];
+} entry_t;
+
+// One thread's ring. Only that thread writes tail and the entries; only the flusher
+// writes head.
+typedef struct ring {
+    alignas(CACHE_LINE_SIZE) _Atomic uint64_t tail; // Next slot to fill
+    alignas(CACHE_LINE_SIZE) _Atomic uint64_t head; // Next slot to drain
+    _Atomic uint32_t space_seq; // Futex word the thread sleeps on while the ring is full
+    _Atomic uint32_t waiting; // Set while the thread is about to sleep
+    struct ring *next; // Next ring in the log's list; fixed once the ring is published
+    entry_t entries[RING_SIZE];
+} ring_t;
+
+typedef struct auditlog {
+    int fd; // Where the lines go
+    pthread_t flusher; // The flusher thread
+    _Atomic(ring_t *) rings; // Every thread's ring, newest first
+
+    // Stamp for the next entry; the one word every recording thread writes
+    alignas(CACHE_LINE_SIZE) _Atomic uint64_t next_stamp;
+
+    // Futex word the flusher sleeps on between drains, bumped to wake it early
+    alignas(CACHE_LINE_SIZE) _Atomic uint32_t flush_seq;
+    _Atomic bool stopping;
+
+    // Flusher state. Entries drained ahead of a stamp the flusher hasn't seen yet wait in
+    // pending, a min-heap on stamp, until the entries before them have been written.
+    entry_t *pending;
+    size_t pending_count;
+    size_t pending_capacity;
+    uint64_t written; // Stamp of the next entry to write
+    char *output; // Lines waiting to be written
+    size_t output_length;
+} auditlog_t;
+
+// The calling thread's ring, and the log it was made for
+static _Thread_local ring_t *thread_ring = NULL;
+static _Thread_local auditlog_t *thread_log = NULL;
+
+// Copy at most size - 1 bytes of a string, always NUL-terminating the copy
+static void copy_field(char *dst, const char *src, size_t size) {
+    size_t i = 0;
+
+    while (i < size - 1 && src[i] != '\0') {
+        dst[i] = src[i];
+        i++;
+    }
+    dst[i] = '\0';
+}
+
+// Wake the flusher before its interval is up
+static void wake_flusher(auditlog_t *log) {
+    atomic_fetch_add_explicit(&(log->flush_seq), 1, memory_order_release);
+    futex_wake(&(log->flush_seq), 1);
+}
+
+// Find the calling thread's ring, creating and publishing it on the thread's first entry
+static ring_t *thread_ring_get(auditlog_t *log) {
+    if (thread_log == log) {
+        return thread_ring;
+    }
+
+    ring_t *ring = aligned_alloc(CACHE_LINE_SIZE, sizeof(ring_t));
+    if (ring == NULL) {
+        fprintf(stderr, "Failed to allocate memory for audit log.\n");
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&(ring->tail), 0);
+    atomic_init(&(ring->head), 0);
+    atomic_init(&(ring->space_seq), 0);
+    atomic_init(&(ring->waiting), 0);
+
+    // Push the ring onto the list; the flusher only ever walks it from the head
+    ring->next = atomic_load_explicit(&(log->rings), memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(
+        &(log->rings), &(ring->next), ring, memory_order_release, memory_order_relaxed)) {
+    }
+
+    thread_ring = ring;
+    thread_log = log;
+    return ring;
+}
+
+// Record one request in the calling thread's ring
+void auditlog_record(
+    auditlog_t *log, const char *method, const char *uri, int status, const char *request_id) {
+    ring_t *ring = thread_ring_get(log);
+    uint64_t tail = atomic_load_explicit(&(ring->tail), memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&(ring->head), memory_order_acquire);
+    uint32_t seq;
+
+    // Wait for the flusher to drain a full ring. The fence pairs with the one in drain(), so
+    // either the flusher sees waiting set or this thread sees the new head.
+    while (tail - head == RING_SIZE) {
+        seq = atomic_load_explicit(&(ring->space_seq), memory_order_acquire);
+        atomic_store_explicit(&(ring->waiting), 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        head = atomic_load_explicit(&(ring->head), memory_order_acquire);
+        if (tail - head == RING_SIZE) {
+            wake_flusher(log);
+            futex_wait(&(ring->space_seq), seq, NULL);
+            head = atomic_load_explicit(&(ring->head), memory_order_acquire);
+        }
+    }
+
+    // The caller holds the resource's lock, so the stamp orders this entry after every
+    // earlier operation on the resource. Relaxed is enough: the lock already orders the
+    // increments, and all increments of one word are totally ordered.
+    entry_t *entry = &(ring->entries[tail % RING_SIZE]);
+    entry->stamp = atomic_fetch_add_explicit(&(log->next_stamp), 1, memory_order_relaxed);
+    entry->status = status;
+    copy_field(entry->method, method, sizeof(entry->method));
+    copy_field(entry->uri, uri, sizeof(entry->uri));
+    copy_field(entry->request_id, request_id != NULL ? request_id : "0",
+        sizeof(entry->request_id));
+    atomic_store_explicit(&(ring->tail), tail + 1, memory_order_release);
+
+    // Don't let a busy thread's ring fill up before the flusher's next pass
+    if (tail + 1 - head == RING_SIZE / 2) {
+        wake_flusher(log);
+    }
+}
+
+// Add an entry to the flusher's heap of entries waiting for an earlier stamp
+static void pending_push(auditlog_t *log, const entry_t *entry) {
+    size_t i, parent;
+    entry_t swap;
+
+    if (log->pending_count == log->pending_capacity) {
+        log->pending_capacity *= 2;
+        log->pending = realloc(log->pending, sizeof(entry_t) * log->pending_capacity);
+        if (log->pending == NULL) {
+            fprintf(stderr, "Failed to allocate memory for audit log.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    i = log->pending_count++;
+    log->pending[i] = *entry;
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (log->pending[parent].stamp <= log->pending[i].stamp) {
+            break;
+        }
+        swap = log->pending[parent];
+        log->pending[parent] = log->pending[i];
+        log->pending[i] = swap;
+        i = parent;
+    }
+}
+
+// Remove the entry with the lowest stamp from the heap
+static void pending_pop(auditlog_t *log) {
+    size_t i = 0, child;
+    entry_t swap;
+
+    log->pending[0] = log->pending[--log->pending_count];
+    for (;;) {
+        child = 2 * i + 1;
+        if (child >= log->pending_count) {
+            break;
+        }
+        if (child + 1 < log->pending_count
+            && log->pending[child + 1].stamp < log->pending[child].stamp) {
+            child++;
+        }
+        if (log->pending[i].stamp <= log->pending[child].stamp) {
+            break;
+        }
+        swap = log->pending[child];
+        log->pending[child] = log->pending[i];
+        log->pending[i] = swap;
+        i = child;
+    }
+}
+
+// Write out the lines collected so far
+static void flush_output(auditlog_t *log) {
+    if (log->output_length > 0) {
+        if (write_n_bytes(log->fd, log->output, log->output_length) == -1) {
+            fprintf(stderr, "Failed to write audit log\n");
+        }
+        log->output_length = 0;
+    }
+}
+
+// Format an entry into the output buffer
+static void append_line(auditlog_t *log, const entry_t *entry) {
+    if (log->output_length + MAX_LINE_LENGTH > OUTPUT_SIZE) {
+        flush_output(log);
+    }
+    log->output_length += snprintf(log->output + log->output_length,
+        OUTPUT_SIZE - log->output_length, "%s,/%s,%d,%s\n", entry->method, entry->uri,
+        entry->status, entry->request_id);
+}
+
+// Move every ring's entries into the heap, then write out the ones whose earlier stamps have
+// all been written. A stamp can only be missing while its thread is between taking it and
+// publishing the entry, so on the final pass, after every thread has stopped, all of them
+// are written.
+static void drain(auditlog_t *log, bool final) {
+    ring_t *ring;
+    uint64_t head, tail;
+
+    for (ring = atomic_load_explicit(&(log->rings), memory_order_acquire); ring != NULL;
+         ring = ring->next) {
+        head = atomic_load_explicit(&(ring->head), memory_order_relaxed);
+        tail = atomic_load_explicit(&(ring->tail), memory_order_acquire);
+        if (head == tail) {
+            continue;
+        }
+        for (; head != tail; head++) {
+            pending_push(log, &(ring->entries[head % RING_SIZE]));
+        }
+        atomic_store_explicit(&(ring->head), head, memory_order_release);
+
+        // Wake the ring's thread if it is waiting for room
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&(ring->waiting), memory_order_relaxed)) {
+            atomic_store_explicit(&(ring->waiting), 0, memory_order_relaxed);
+            atomic_fetch_add_explicit(&(ring->space_seq), 1, memory_order_release);
+            futex_wake(&(ring->space_seq), 1);
+        }
+    }
+
+    while (log->pending_count > 0 && (final || log->pending[0].stamp == log->written)) {
+        append_line(log, &(log->pending[0]));
+        log->written = log->pending[0].stamp + 1;
+        pending_pop(log);
+    }
+    flush_output(log);
+}
+
+// Flusher thread: drain the rings every interval, or sooner when woken
+static void *flusher_thread(void *arg) {
+    auditlog_t *log = (auditlog_t *) arg;
+    struct timespec deadline;
+    uint32_t seq;
+    bool stopping;
+
+    for (;;) {
+        // Read the futex word first, so a wake-up during the drain isn't slept through
+        seq = atomic_load_explicit(&(log->flush_seq), memory_order_acquire);
+        stopping = atomic_load_explicit(&(log->stopping), memory_order_acquire);
+        drain(log, stopping);
+        if (stopping) {
+            break;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += FLUSH_INTERVAL_NS;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        futex_wait(&(log->flush_seq), seq, &deadline);
+    }
+
+    return NULL;
+}
+
+// Create a log and start its flusher
+auditlog_t *auditlog_new(int fd) {
+    auditlog_t *log = aligned_alloc(CACHE_LINE_SIZE, sizeof(auditlog_t));
+    if (log == NULL) {
+        fprintf(stderr, "Failed to allocate memory for audit log.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    log->fd = fd;
+    atomic_init(&(log->rings), NULL);
+    atomic_init(&(log->next_stamp), 0);
+    atomic_init(&(log->flush_seq), 0);
+    atomic_init(&(log->stopping), false);
+    log->pending_capacity = RING_SIZE;
+    log->pending_count = 0;
+    log->pending = malloc(sizeof(entry_t) * log->pending_capacity);
+    log->written = 0;
+    log->output = malloc(OUTPUT_SIZE);
+    log->output_length = 0;
+    if (log->pending == NULL || log->output == NULL) {
+        fprintf(stderr, "Failed to allocate memory for audit log.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (pthread_create(&(log->flusher), NULL, flusher_thread, log) != 0) {
+        fprintf(stderr, "Failed to create audit log thread.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return log;
+}
+
+// Write out everything recorded, make it durable, and free the log
+void auditlog_delete(auditlog_t **log) {
+    if (log == NULL || *log == NULL) {
+        return;
+    }
+
+    auditlog_t *l = *log;
+    atomic_store_explicit(&(l->stopping), true, memory_order_release);
+    wake_flusher(l);
+    pthread_join(l->flusher, NULL);
+
+    // A terminal or pipe can't be synced, and there is nothing more to make durable then
+    fsync(l->fd);
+
+    ring_t *ring = atomic_load_explicit(&(l->rings), memory_order_relaxed);
+    while (ring != NULL) {
+        ring_t *next = ring->next;
+        free(ring);
+        ring = next;
+    }
+    free(l->pending);
+    free(l->output);
+    free(l);
+    *log = NULL;
+}
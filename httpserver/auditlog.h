@@ -0,0 +1,66 @@
+/**
+ * @File auditlog.h
+ *
+ * An asynchronous audit log with one line per request:
+ *
+ *   method,/uri,status,request-id
+ *
+ * Each worker thread appends entries to its own single-producer ring
+ * buffer, so logging never takes a lock or makes a system call on the
+ * request path.  A background flusher thread drains the rings and
+ * writes the lines in batches.
+ *
+ * Every entry is stamped from one global counter.  Recording an entry
+ * inside a resource's critical section therefore gives it a stamp
+ * that respects the order in which operations on that resource took
+ * effect.  The flusher writes entries strictly in stamp order, holding
+ * back any that arrive ahead of a stamp it hasn't seen yet.
+ *
+ * @author Ishika Pol
+ */
+
+#pragma once
+
+/** @struct auditlog_t
+ *
+ *  @brief This typedef renames the struct auditlog.
+ */
+typedef struct auditlog auditlog_t;
+
+/** @brief Dynamically allocates a new audit log and starts its
+ *         flusher thread.
+ *
+ *  @param fd the descriptor the log lines are written to.  It stays
+ *         owned by the caller.
+ *
+ *  @return a pointer to a new auditlog_t
+ */
+auditlog_t *auditlog_new(int fd);
+
+/** @brief Write every recorded entry, fsync() the log, stop the
+ *         flusher and free all of the log's memory.
+ *
+ *  @param log the log to be deleted.  *log is set to NULL on return.
+ *  No thread may record entries at this point.
+ */
+void auditlog_delete(auditlog_t **log);
+
+/** @brief Record one request.  Call it inside the critical section in
+ *         which the request took effect, so its place in the log
+ *         matches its place in the resource's history.
+ *
+ *  @param log the log.
+ *
+ *  @param method the request method.  Methods longer than 8 characters
+ *         are truncated.
+ *
+ *  @param uri the URI without the leading '/'.  URIs longer than 64
+ *         characters are truncated.
+ *
+ *  @param status the status code sent in response.
+ *
+ *  @param request_id the Request-Id header, or NULL to log "0".  IDs
+ *         longer than 128 characters are truncated.
+ */
+void auditlog_record(
+    auditlog_t *log, const char *method, const char *uri, int status, const char *request_id);
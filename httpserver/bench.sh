@@ -0,0 +1,62 @@
+#!/bin/sh
+# End-to-end benchmark suite for httpserver. Starts ./httpserver on a loopback port in a
+# scratch directory, runs ./loadgen over a sweep of configurations and prints one CSV row per
+# run. Fails if the server can't be started or any run sees an inconsistent GET.
+#
+#   PORT         port the server listens on (default 8089)
+#   DURATION     milliseconds per run (default 2000)
+#   SERVER_ARGS  extra server flags, e.g. "-e -t 4 -c 64" (default "-e -t 4")
+#
+# The server runs event-driven by default: in threaded mode every kept-alive connection holds a
+# worker until it closes, so the 16-thread runs would leave 12 connections queued for the whole
+# run and measure that instead of the server.
+
+PORT=${PORT:-8089}
+DURATION=${DURATION:-2000}
+SERVER_ARGS=${SERVER_ARGS:-"-e -t 4"}
+here=$(pwd)
+dir=$(mktemp -d)
+status=0
+
+# shellcheck disable=SC2086
+(cd "$dir" && exec "$here/httpserver" $SERVER_ARGS "$PORT") &
+server=$!
+trap 'kill -TERM $server 2>/dev/null; wait $server; rm -rf "$dir"' EXIT
+
+# Wait for the server to accept connections
+tries=0
+until ./loadgen -d 1 -t 1 -f 1 -w 0 "$PORT" >/dev/null 2>&1; do
+    tries=$((tries + 1))
+    if [ $tries -ge 50 ] || ! kill -0 $server 2>/dev/null; then
+        echo "Failed to start httpserver on port $PORT" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+header=-H
+run() {
+    ./loadgen $header -d "$DURATION" "$@" "$PORT" || status=1
+    header=
+}
+
+# Closed loop over kept-alive connections: scale threads and the share of PUTs
+for threads in 1 4 16; do
+    for puts in 0 100 500; do
+        run -t $threads -w $puts
+    done
+done
+
+# A connection per request, skewed access and large files
+run -t 4 -c
+run -t 16 -w 100 -z 1.0
+run -t 16 -w 500 -z 1.2 -f 64
+run -t 4 -w 100 -s 1048576 -f 4
+
+# Open loop at fixed rates, where the corrected percentiles include time spent waiting
+# behind a slow response
+for rate in 1000 5000 20000; do
+    run -t 16 -w 100 -r $rate
+done
+
+exit $status
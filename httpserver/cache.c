@@ -0,0 +1,293 @@
+// Main File - cache.c
+// Ishika Pol - CSE130
+// Sharded cache of small files' responses with CLOCK eviction, validated against stat() and
+// invalidated on PUT.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cache.h"
+#include "rwlock.h"
+
+// Hash buckets per shard
+#define SHARD_BUCKETS 64
+
+// Lookups only read the shard, so they share its lock; inserts and removals take it for writing
+typedef struct shard {
+    rwlock_t *lock; // Protects everything else in the shard
+    cache_entry_t *buckets[SHARD_BUCKETS]; // Hash chains of the shard's entries
+    cache_entry_t *head; // Most recently inserted entry
+    cache_entry_t *tail; // Oldest entry, where eviction starts
+    size_t used; // Bytes of responses held by the shard
+} shard_t;
+
+typedef struct cache {
+    size_t shard_capacity; // Maximum bytes of responses per shard
+    size_t max_object; // Largest file that will be cached
+    int nshards; // Number of shards
+    shard_t *shards; // The array of shards
+} cache_t;
+
+// Hash a URI (djb2)
+static unsigned long hash_uri(const char *uri) {
+    unsigned long hash = 5381;
+
+    for (const char *c = uri; *c != '\0'; c++) {
+        hash = hash * 33 + (unsigned char) *c;
+    }
+
+    return hash;
+}
+
+// Whether an entry was read from the file that st describes
+static int entry_matches(const cache_entry_t *entry, const struct stat *st) {
+    return entry->ino == st->st_ino && entry->size == st->st_size
+           && entry->mtime.tv_sec == st->st_mtim.tv_sec
+           && entry->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+// Drop a reference, freeing the entry once nobody holds one
+void cache_release(cache_entry_t *entry) {
+    if (atomic_fetch_sub(&(entry->refcount), 1) == 1) {
+        free(entry->data);
+        free(entry->uri);
+        free(entry);
+    }
+}
+
+// Find an entry in a shard's hash chain, along with the pointer that links to it
+static cache_entry_t **find_link(shard_t *shard, unsigned long hash, const char *uri) {
+    cache_entry_t **link = &(shard->buckets[hash % SHARD_BUCKETS]);
+
+    while (*link != NULL && strcmp((*link)->uri, uri) != 0) {
+        link = &((*link)->chain);
+    }
+
+    return link;
+}
+
+// Unlink an entry from the eviction list
+static void lru_remove(shard_t *shard, cache_entry_t *entry) {
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        shard->head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    } else {
+        shard->tail = entry->prev;
+    }
+}
+
+// Put an entry at the newest end of the eviction list
+static void lru_push(shard_t *shard, cache_entry_t *entry) {
+    entry->prev = NULL;
+    entry->next = shard->head;
+    if (shard->head != NULL) {
+        shard->head->prev = entry;
+    } else {
+        shard->tail = entry;
+    }
+    shard->head = entry;
+}
+
+// Remove an entry from the shard (the caller holds the shard lock for writing) and drop the
+// cache's reference; readers still holding one keep the memory alive
+static void remove_entry(shard_t *shard, cache_entry_t **link) {
+    cache_entry_t *entry = *link;
+
+    *link = entry->chain;
+    lru_remove(shard, entry);
+    shard->used -= entry->length;
+    cache_release(entry);
+}
+
+// Evict one entry (the caller holds the shard lock for writing). This is CLOCK: an entry read
+// since the hand last passed it gets a second chance and goes back to the newest end, so hits
+// only have to set a flag instead of reordering the list under the lock.
+static void evict_one(shard_t *shard) {
+    cache_entry_t *entry;
+
+    while ((entry = shard->tail) != NULL && atomic_load(&(entry->referenced))) {
+        atomic_store(&(entry->referenced), false);
+        lru_remove(shard, entry);
+        lru_push(shard, entry);
+    }
+    if (entry != NULL) {
+        remove_entry(shard, find_link(shard, hash_uri(entry->uri), entry->uri));
+    }
+}
+
+// Create a new cache
+cache_t *cache_new(size_t capacity, size_t max_object, int shards) {
+    cache_t *c = (cache_t *) malloc(sizeof(cache_t));
+    if (c == NULL) {
+        fprintf(stderr, "Failed to allocate memory for cache.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    c->shard_capacity = capacity / shards;
+    c->max_object = max_object;
+    c->nshards = shards;
+    c->shards = (shard_t *) calloc(shards, sizeof(shard_t));
+    if (c->shards == NULL) {
+        fprintf(stderr, "Failed to allocate memory for cache.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < shards; i++) {
+        // Writers are rare (misses, PUTs and stale entries), so let them in ahead of new readers
+        c->shards[i].lock = rwlock_new(WRITERS, 0);
+    }
+
+    return c;
+}
+
+// Delete the cache and release associated resources
+void cache_delete(cache_t **c) {
+    if (c == NULL || *c == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < (*c)->nshards; i++) {
+        shard_t *shard = &((*c)->shards[i]);
+
+        while (shard->head != NULL) {
+            remove_entry(shard, find_link(shard, hash_uri(shard->head->uri), shard->head->uri));
+        }
+        rwlock_delete(&(shard->lock));
+    }
+
+    free((*c)->shards);
+    free(*c);
+    *c = NULL;
+}
+
+// Find the cached response for a URI, checking that the file hasn't changed since
+cache_entry_t *cache_lookup(cache_t *c, const char *uri) {
+    unsigned long hash = hash_uri(uri);
+    shard_t *shard = &(c->shards[hash % c->nshards]);
+    cache_entry_t **link;
+    cache_entry_t *entry;
+    struct stat st;
+
+    // Concurrent hits on the same hot file share the lock and leave the list alone
+    reader_lock(shard->lock);
+    entry = *find_link(shard, hash, uri);
+    if (entry != NULL) {
+        // Mark the entry for the eviction hand, skipping the store once it is already marked so
+        // repeated hits don't keep dirtying its cache line, and take a reference for the caller
+        if (!atomic_load_explicit(&(entry->referenced), memory_order_relaxed)) {
+            atomic_store_explicit(&(entry->referenced), true, memory_order_relaxed);
+        }
+        atomic_fetch_add(&(entry->refcount), 1);
+    }
+    reader_unlock(shard->lock);
+
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    // A stat() is much cheaper than reopening the file, and catches changes made behind our back
+    if (stat(uri, &st) == 0 && entry_matches(entry, &st)) {
+        return entry;
+    }
+
+    // The file changed; drop the entry unless someone already replaced it
+    writer_lock(shard->lock);
+    link = find_link(shard, hash, uri);
+    if (*link == entry) {
+        remove_entry(shard, link);
+    }
+    writer_unlock(shard->lock);
+    cache_release(entry);
+
+    return NULL;
+}
+
+// Read a file into a new entry and cache it
+cache_entry_t *cache_insert(cache_t *c, const char *uri, const struct stat *st,
+    const char *header, size_t header_length, int fd) {
+    unsigned long hash = hash_uri(uri);
+    shard_t *shard = &(c->shards[hash % c->nshards]);
+    cache_entry_t **link;
+    cache_entry_t *entry;
+    size_t length = header_length + st->st_size;
+    ssize_t bytes_read;
+    off_t offset = 0;
+
+    if (!S_ISREG(st->st_mode) || (size_t) st->st_size > c->max_object
+        || length > c->shard_capacity) {
+        return NULL;
+    }
+
+    entry = (cache_entry_t *) malloc(sizeof(cache_entry_t));
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->data = (char *) malloc(length);
+    entry->uri = strdup(uri);
+    if (entry->data == NULL || entry->uri == NULL) {
+        free(entry->data);
+        free(entry->uri);
+        free(entry);
+        return NULL;
+    }
+
+    // Build the complete response: the header, then the file content
+    memcpy(entry->data, header, header_length);
+    while (offset < st->st_size) {
+        bytes_read = pread(fd, entry->data + header_length + offset, st->st_size - offset, offset);
+        if (bytes_read <= 0) {
+            free(entry->data);
+            free(entry->uri);
+            free(entry);
+            return NULL;
+        }
+        offset += bytes_read;
+    }
+
+    entry->header_length = header_length;
+    entry->length = length;
+    entry->ino = st->st_ino;
+    entry->size = st->st_size;
+    entry->mtime = st->st_mtim;
+    // One reference for the cache and one for the caller
+    atomic_init(&(entry->refcount), 2);
+    atomic_init(&(entry->referenced), false);
+
+    writer_lock(shard->lock);
+
+    // Replace any older entry for the URI, then evict until the new one fits
+    link = find_link(shard, hash, uri);
+    if (*link != NULL) {
+        remove_entry(shard, link);
+    }
+    while (shard->used + length > c->shard_capacity && shard->tail != NULL) {
+        evict_one(shard);
+    }
+
+    entry->chain = shard->buckets[hash % SHARD_BUCKETS];
+    shard->buckets[hash % SHARD_BUCKETS] = entry;
+    lru_push(shard, entry);
+    shard->used += length;
+
+    writer_unlock(shard->lock);
+
+    return entry;
+}
+
+// Drop the cached response for a URI
+void cache_invalidate(cache_t *c, const char *uri) {
+    unsigned long hash = hash_uri(uri);
+    shard_t *shard = &(c->shards[hash % c->nshards]);
+    cache_entry_t **link;
+
+    writer_lock(shard->lock);
+    link = find_link(shard, hash, uri);
+    if (*link != NULL) {
+        remove_entry(shard, link);
+    }
+    writer_unlock(shard->lock);
+}
@@ -0,0 +1,124 @@
+/**
+ * @File cache.h
+ *
+ * A size-bounded, in-memory cache of small files for GET.  Each entry
+ * holds the full response (header followed by file content) for one
+ * URI, so a hit is served with a single write.  The cache is split
+ * into shards, each with its own reader/writer lock, so lookups for
+ * different URIs rarely contend.  Lookups take the lock for reading
+ * and only mark the entry as used, so lookups of the same hot URI
+ * don't serialize either; eviction is CLOCK, which gives recently used
+ * entries a second chance.
+ *
+ * Entries remember the inode, size and modification time of the file
+ * they were read from; cache_lookup() checks them against a fresh
+ * stat() and drops entries whose file has changed.  Writers should
+ * also call cache_invalidate() when they replace a file.
+ *
+ * @author Ishika Pol
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/** @struct cache_t
+ *
+ *  @brief This typedef renames the struct cache.
+ */
+typedef struct cache cache_t;
+
+/** @struct cache_entry_t
+ *
+ *  @brief A cached response.  Callers may read data, header_length,
+ *  length, and the ino, size and mtime of the cached file; the
+ *  remaining fields belong to the cache.
+ */
+typedef struct cache_entry {
+    char *data; // The response header followed by the file content
+    size_t header_length; // Bytes of data taken by the response header
+    size_t length; // Total bytes of data
+    char *uri; // URI the entry is cached under
+    ino_t ino; // Inode, size and modification time of the cached file
+    off_t size;
+    struct timespec mtime;
+    atomic_int refcount; // One reference for the cache itself plus one per reader
+    atomic_bool referenced; // Looked up since the eviction hand last passed it
+    struct cache_entry *chain; // Next entry in the same hash bucket
+    struct cache_entry *prev; // Neighbours in the shard's eviction list, newest first
+    struct cache_entry *next;
+} cache_entry_t;
+
+/** @brief Dynamically allocates and initializes a new cache.
+ *
+ *  @param capacity the maximum number of bytes of responses to hold,
+ *         split evenly across the shards.
+ *
+ *  @param max_object the largest file, in bytes, that will be cached.
+ *
+ *  @param shards the number of independently locked shards.
+ *
+ *  @return a pointer to a new cache_t
+ */
+cache_t *cache_new(size_t capacity, size_t max_object, int shards);
+
+/** @brief Delete the cache and free all of its memory.  No entries
+ *         may still be referenced by readers.
+ *
+ *  @param c the cache to be deleted.  *c is set to NULL on return.
+ */
+void cache_delete(cache_t **c);
+
+/** @brief Find the cached response for a URI, provided the file has
+ *         not changed since it was cached.
+ *
+ *  @param c the cache.
+ *
+ *  @param uri the URI (which is also the file's path).
+ *
+ *  @return a referenced entry, which must be passed to
+ *          cache_release() when the caller is done with it, or NULL.
+ */
+cache_entry_t *cache_lookup(cache_t *c, const char *uri);
+
+/** @brief Read a file into a new entry and cache it, replacing any
+ *         older entry for the URI.  Files larger than max_object, or
+ *         that are not regular files, are not cached.
+ *
+ *  @param c the cache.
+ *
+ *  @param uri the URI to cache the response under.
+ *
+ *  @param st the result of fstat() on fd.
+ *
+ *  @param header the response header to store before the content.
+ *
+ *  @param header_length the length of header.
+ *
+ *  @param fd an open descriptor for the file; it is read with pread()
+ *         so its offset is unchanged.
+ *
+ *  @return a referenced entry, which must be passed to
+ *          cache_release(), or NULL if the file was not cached.
+ */
+cache_entry_t *cache_insert(cache_t *c, const char *uri, const struct stat *st,
+    const char *header, size_t header_length, int fd);
+
+/** @brief Drop the cached response for a URI, if there is one.
+ *
+ *  @param c the cache.
+ *
+ *  @param uri the URI whose file was replaced.
+ */
+void cache_invalidate(cache_t *c, const char *uri);
+
+/** @brief Release a reference returned by cache_lookup() or
+ *         cache_insert().
+ *
+ *  @param entry the entry.
+ */
+void cache_release(cache_entry_t *entry);
@@ -4,69 +4,265 @@
 
 // Citation: Used code from Mitchell's section
 
+#define _GNU_SOURCE
+
 #include <assert.h>
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <regex.h>
+#include <sys/epoll.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
-#include "asgn2_helper_funcs.h"
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <sys/time.h>
+#include "auditlog.h"
+#include "cache.h"
+#include "helper_funcs.h"
+#include "locktable.h"
+#include "metrics.h"
+#include "queue.h"
+#include "request.h"
 
 #define MAX_REQUEST_BUFFER_SIZE 2048
 
-// Read data from the client connection and set message pointer (message_body)
-int my_read(int fd, char *request_buffer, char **message_body) {
-    int total_bytes_read = 0;
-    int bytes_read_this_iteration;
+// Template for the temp file a PUT body is streamed into before being renamed into place.
+// URIs cannot contain '-', so clients can never address a temp file directly.
+#define PUT_TEMP_TEMPLATE "httpserver-put-XXXXXX"
+
+// Number of worker threads used when -t is not given
+#define DEFAULT_THREADS 4
+// Maximum number of accepted connections waiting for a free worker. queue_new() rounds its
+// capacity up to a power of two, so keep this one.
+#define QUEUE_SIZE 64
+// Number of buckets in the per-URI lock table
+#define LOCK_TABLE_BUCKETS 256
+// Readers admitted on a URI while a writer waits before the writer gets its turn (N_WAY)
+#define LOCK_NWAY_READERS 8
+// Maximum number of events handled per epoll_wait() call in event-driven mode
+#define MAX_EVENTS 64
+// Socket timeout, in seconds, for the blocking I/O a worker does (matches listener_accept)
+#define SOCKET_TIMEOUT 5
+// Seconds a connection may sit without sending anything before the event loop closes it
+#define IDLE_TIMEOUT 5
+// Capacity requested for each worker's splice pipe; larger pipes mean fewer splice() calls
+#define SPLICE_PIPE_SIZE (1 << 20)
+// Largest file the GET cache will hold, and the number of independently locked cache shards
+#define CACHE_MAX_OBJECT (64 * 1024)
+#define CACHE_SHARDS 16
+// Room for an ETag or Last-Modified value, and the date format Last-Modified uses
+#define VALIDATOR_SIZE 64
+#define HTTP_DATE_FORMAT "%a, %d %b %Y %H:%M:%S GMT"
+
+typedef enum {
+    CONN_READING, // Still receiving the request line and headers
+    CONN_READY // Headers are complete (or can never be), so a worker can take over
+} conn_state_t;
+
+// A client connection together with the request bytes received on it so far
+typedef struct conn {
+    int fd; // Client socket
+    conn_state_t state; // Where the connection is in the header parsing state machine
+    int bytes_read; // Number of bytes in request_buffer
+    int scanned; // Bytes of request_buffer already searched for the end of the headers
+    char *message_body; // Start of the body inside request_buffer, once the headers are complete
+    int request_length; // Bytes of request_buffer used by the current request, including its body
+    int keep_alive; // Whether the connection may serve another request after this one
+    const char *method; // Method of the current request, NULL if it didn't parse (for metrics)
+    int status; // Status the current request was answered with
+    uint64_t bytes_in; // Bytes of the current request, headers and body
+    int requests; // Number of requests served on the connection so far
+    time_t last_active; // When the event loop last saw bytes arrive (CLOCK_MONOTONIC seconds)
+    struct conn *prev; // Neighbours in the event loop's list of connections it owns
+    struct conn *next;
+    char request_buffer[MAX_REQUEST_BUFFER_SIZE + 1];
+} conn_t;
+
+// Connections owned by the event loop, most recently active first
+typedef struct conn_list {
+    conn_t *head;
+    conn_t *tail;
+} conn_list_t;
+
+// Queue of connections, filled by the dispatcher or event loop and drained by the workers
+queue_t *request_queue;
+// Per-URI reader/writer locks that make concurrent GETs and PUTs on one resource linearizable
+locktable_t *uri_locks;
+// Cache of small files' GET responses, or NULL unless enabled with -c
+cache_t *file_cache = NULL;
+// Audit log of every parsed request, or NULL unless enabled with -l
+auditlog_t *audit_log = NULL;
+// Request metrics served at /metrics, or NULL unless enabled with -m
+metrics_t *server_metrics = NULL;
+// Number of worker threads, reported with the metrics
+int worker_count = DEFAULT_THREADS;
+// Set by the signal handler to tell the dispatcher to stop accepting connections
+volatile sig_atomic_t shutting_down = 0;
+// Whether connections come from the epoll event loop (-e) rather than the blocking dispatcher
+int event_driven = 0;
+
+// Idle keep-alive connections that workers hand back to the event loop
+pthread_mutex_t handback_mutex = PTHREAD_MUTEX_INITIALIZER;
+conn_t *handback_list = NULL;
+// eventfd the event loop watches to learn that handback_list is non-empty
+int handback_fd = -1;
+
+// Each worker's pipe for splicing PUT bodies from the socket into the file, and its capacity
+_Thread_local int splice_pipe[2] = { -1, -1 };
+_Thread_local size_t splice_pipe_size = 0;
+// Bytes this thread has sent to clients, for the metrics
+_Thread_local uint64_t bytes_sent = 0;
+
+// Allocate a connection for a freshly accepted client socket
+conn_t *conn_new(int fd) {
+    conn_t *conn = (conn_t *) malloc(sizeof(conn_t));
+    if (conn == NULL) {
+        return NULL;
+    }
+
+    conn->fd = fd;
+    conn->state = CONN_READING;
+    conn->bytes_read = 0;
+    conn->scanned = 0;
+    conn->message_body = NULL;
+    conn->request_length = 0;
+    conn->keep_alive = 1;
+    conn->method = NULL;
+    conn->status = 0;
+    conn->bytes_in = 0;
+    conn->requests = 0;
+    conn->last_active = 0;
+    conn->prev = NULL;
+    conn->next = NULL;
+    conn->request_buffer[0] = '\0';
+
+    return conn;
+}
+
+// Close the client socket and free the connection
+void conn_free(conn_t *conn) {
+    close(conn->fd);
+    free(conn);
+}
+
+// Look for the end of the headers in the bytes buffered so far and move the connection to
+// CONN_READY once they are complete (or can never fit in the buffer)
+void conn_scan(conn_t *conn) {
     char *delimfound;
     char delimiter[] = "\r\n\r\n";
 
-    do {
-        bytes_read_this_iteration = read(
-            fd, request_buffer + total_bytes_read, MAX_REQUEST_BUFFER_SIZE - total_bytes_read);
+    // Only search the new bytes, plus enough old ones to catch a delimiter split across reads
+    delimfound = strstr(conn->request_buffer + conn->scanned, delimiter);
+    if (delimfound != NULL) {
+        conn->message_body = delimfound + strlen(delimiter);
+        conn->state = CONN_READY;
+        return;
+    }
+
+    conn->scanned = conn->bytes_read - (int) strlen(delimiter) + 1;
+    if (conn->scanned < 0) {
+        conn->scanned = 0;
+    }
+
+    // The headers don't fit in the buffer; a worker will answer with 400
+    if (conn->bytes_read >= MAX_REQUEST_BUFFER_SIZE) {
+        conn->state = CONN_READY;
+    }
+}
+
+// Read from the client until the request headers are complete, advancing the state machine.
+// On a non-blocking socket this returns as soon as no more bytes are available; on a blocking
+// one it waits, up to the socket timeout. Returns 1 once the connection is CONN_READY, 0 if
+// more bytes are needed (or the read timed out), and -1 if the connection should be dropped.
+int conn_fill(conn_t *conn) {
+    int bytes_read_this_iteration;
+
+    // A pipelined request may already be sitting in the buffer
+    conn_scan(conn);
+
+    while (conn->state == CONN_READING) {
+        bytes_read_this_iteration = read(conn->fd, conn->request_buffer + conn->bytes_read,
+            MAX_REQUEST_BUFFER_SIZE - conn->bytes_read);
 
         if (bytes_read_this_iteration == -1) {
-            // Failed to read
-            return -1;
+            if (errno == EINTR) {
+                continue;
+            }
+            // Nothing more to read right now (or the read timed out)
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
         } else if (bytes_read_this_iteration == 0) {
-            // No more bytes to read
-            return total_bytes_read;
-        } else {
-            total_bytes_read += bytes_read_this_iteration;
-            request_buffer[total_bytes_read] = '\0'; // Null-terminate the buffer
-
-            delimfound = strstr(request_buffer, delimiter);
-            if (delimfound != NULL) {
-                // Set message pointer (ml) to the beginning of the message (body)
-                *message_body = delimfound + strlen(delimiter);
-                return total_bytes_read;
+            // The client stopped sending; let a worker reject a partial request
+            if (conn->bytes_read == 0) {
+                return -1;
             }
+            conn->state = CONN_READY;
+            return 1;
         }
-    } while (total_bytes_read < MAX_REQUEST_BUFFER_SIZE);
 
-    return total_bytes_read;
+        conn->bytes_read += bytes_read_this_iteration;
+        conn->request_buffer[conn->bytes_read] = '\0';
+        conn_scan(conn);
+    }
+
+    return 1;
 }
 
-void send_error_response(int fd, int http_status) {
-    char response_buffer[MAX_REQUEST_BUFFER_SIZE];
-    const char *status_text = "Unknown Error";
-    int content_length = 0;
+// Drop the request that was just served from the buffer, keeping any pipelined bytes that
+// followed it, and get ready to parse the next request on the connection
+void conn_next_request(conn_t *conn) {
+    int leftover = conn->bytes_read - conn->request_length;
 
+    memmove(conn->request_buffer, conn->request_buffer + conn->request_length, leftover);
+    conn->bytes_read = leftover;
+    conn->request_buffer[leftover] = '\0';
+    conn->state = CONN_READING;
+    conn->scanned = 0;
+    conn->message_body = NULL;
+    conn->request_length = 0;
+    conn->keep_alive = 1;
+    conn->requests++;
+}
+
+// Write a whole buffer to a client, counting what was sent for the metrics
+ssize_t send_bytes(int fd, char *buf, size_t n) {
+    ssize_t written = write_n_bytes(fd, buf, n);
+
+    if (written > 0) {
+        bytes_sent += written;
+    }
+    return written;
+}
+
+// Reason phrase sent with an error status, which is also the error response's body
+const char *error_status_text(int http_status) {
     switch (http_status) {
-    case 400: status_text = "Bad Request"; break;
-    case 403: status_text = "Forbidden"; break;
-    case 404: status_text = "Not Found"; break;
-    case 500: status_text = "Internal Server Error"; break;
-    case 501: status_text = "Not Implemented"; break;
-    case 505: status_text = "Version Not Supported"; break;
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 416: return "Range Not Satisfiable";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    case 505: return "Version Not Supported";
     }
+    return "Unknown Error";
+}
+
+void send_error_response(int fd, int http_status) {
+    char response_buffer[MAX_REQUEST_BUFFER_SIZE];
+    const char *status_text = error_status_text(http_status);
+    int content_length = 0;
 
     // Set the appropriate content length and create the response
     content_length = strlen(status_text) + 1;
@@ -75,190 +271,962 @@ void send_error_response(int fd, int http_status) {
         content_length, status_text);
 
     // Send the error response to the client
-    write_n_bytes(fd, response_buffer, strlen(response_buffer));
+    send_bytes(fd, response_buffer, strlen(response_buffer));
 }
 
-// Handle the incoming HTTP request and send a response
-int handle_request(int fd) {
-    struct stat file_info;
-    regex_t request_regex;
-    regmatch_t request_matches[4];
-    int bytes_read, bytes_written, file_descriptor, content_length;
-    int response_status, existing_file = 0;
-    char request_buffer[MAX_REQUEST_BUFFER_SIZE + 1], response_buffer[MAX_REQUEST_BUFFER_SIZE];
-    char *method, *resource, *http_version, *headers, *message_body, *key, *value;
-
-    // Read the client's request and set the message body pointer
-    bytes_read = my_read(fd, request_buffer, &message_body);
-
-    // If there was an error reading the connection
-    if (bytes_read == -1) {
-        send_error_response(fd, 400);
-        return 1;
+// Send the header of an error response without its body, as the answer to a HEAD request
+void send_error_head(int fd, int http_status) {
+    char response_buffer[MAX_REQUEST_BUFFER_SIZE];
+    const char *status_text = error_status_text(http_status);
+
+    snprintf(response_buffer, sizeof(response_buffer),
+        "HTTP/1.1 %d %s\r\nContent-Length: %d\r\n\r\n", http_status, status_text,
+        (int) strlen(status_text) + 1);
+    send_bytes(fd, response_buffer, strlen(response_buffer));
+}
+
+// Send count bytes of a file, starting at offset, with sendfile() so the data goes from the
+// page cache to the socket without passing through a user-space buffer. Falls back to
+// read/write when the file can't be sendfile()d. Returns 0 once every byte is sent, or -1 if
+// the transfer failed, including when the socket's send timeout expired.
+int send_file(int out, int in, off_t offset, size_t count) {
+    ssize_t sent;
+
+    while (count > 0) {
+        sent = sendfile(out, in, &offset, count);
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // This file can't be sendfile()d, so copy the rest through a buffer instead
+            if (errno == EINVAL || errno == ENOSYS) {
+                if (lseek(in, offset, SEEK_SET) == -1) {
+                    return -1;
+                }
+                sent = pass_n_bytes(in, out, count);
+                if (sent > 0) {
+                    bytes_sent += sent;
+                }
+                return sent == (ssize_t) count ? 0 : -1;
+            }
+            return -1;
+        } else if (sent == 0) {
+            // The file got shorter than its stat() said
+            return -1;
+        }
+
+        // sendfile() may send fewer bytes than asked for; keep going from the new offset
+        bytes_sent += sent;
+        count -= sent;
     }
 
-    // Null-terminate the request
-    request_buffer[bytes_read] = '\0';
+    return 0;
+}
+
+// Drop this thread's splice pipe, e.g. after an error left data in it
+void close_splice_pipe(void) {
+    if (splice_pipe[0] != -1) {
+        close(splice_pipe[0]);
+        close(splice_pipe[1]);
+        splice_pipe[0] = -1;
+        splice_pipe[1] = -1;
+    }
+}
+
+// Receive count bytes from a socket into a file with splice(), moving them through this
+// thread's pipe so they are never copied into user space. Falls back to read/write when the
+// socket or file can't be spliced. Returns 0 once every byte is written, or -1 if the client
+// went away, the socket's receive timeout expired, or the file couldn't be written.
+int receive_file(int in, int out, size_t count) {
+    ssize_t moved, drained;
+
+    // Create the pipe on first use and grow it so each splice() moves more data
+    if (splice_pipe[0] == -1) {
+        if (pipe(splice_pipe) == -1) {
+            splice_pipe[0] = -1;
+            splice_pipe[1] = -1;
+            return pass_n_bytes(in, out, count) == (ssize_t) count ? 0 : -1;
+        }
+        fcntl(splice_pipe[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+        splice_pipe_size = fcntl(splice_pipe[1], F_GETPIPE_SZ);
+    }
+
+    while (count > 0) {
+        moved = splice(in, NULL, splice_pipe[1], NULL,
+            count < splice_pipe_size ? count : splice_pipe_size, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (moved == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // The pipe is always empty here, so the rest can be copied through a buffer
+            if (errno == EINVAL) {
+                return pass_n_bytes(in, out, count) == (ssize_t) count ? 0 : -1;
+            }
+            return -1;
+        } else if (moved == 0) {
+            // The client closed the connection before sending the whole body
+            return -1;
+        }
+        count -= moved;
+
+        // Empty the pipe into the file before reading more from the socket
+        while (moved > 0) {
+            drained = splice(splice_pipe[0], NULL, out, NULL, moved, SPLICE_F_MOVE);
+            if (drained == -1 && errno == EINTR) {
+                continue;
+            } else if (drained <= 0) {
+                // Don't leave stale bytes in the pipe for the next upload
+                close_splice_pipe();
+                return -1;
+            }
+            moved -= drained;
+        }
+    }
+
+    return 0;
+}
+
+// Deadline for taking a resource's lock: as long as a blocking socket operation may take
+void lock_deadline(struct timespec *deadline) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += SOCKET_TIMEOUT;
+}
+
+// Validators for one version of a file. The ETag is built from the inode, size and
+// modification time, which change whenever a PUT renames a new file into place or the file
+// is edited in place; Last-Modified is the modification time as an HTTP date.
+void file_validators(char *etag, char *last_modified, ino_t ino, off_t size,
+    const struct timespec *mtime) {
+    struct tm tm;
+
+    snprintf(etag, VALIDATOR_SIZE, "\"%lx-%lx-%lx.%lx\"", (unsigned long) ino,
+        (unsigned long) size, (unsigned long) mtime->tv_sec, (unsigned long) mtime->tv_nsec);
+    gmtime_r(&(mtime->tv_sec), &tm);
+    strftime(last_modified, VALIDATOR_SIZE, HTTP_DATE_FORMAT, &tm);
+}
+
+// Check whether an If-None-Match list names the ETag. Weak tags ("W/...") compare by their
+// opaque part, which is all a GET needs.
+int etag_matches(const char *list, const char *etag) {
+    size_t etag_length = strlen(etag), length;
+    const char *p = list;
+
+    while (*p != '\0') {
+        while (*p == ' ' || *p == ',') {
+            p++;
+        }
+        if (*p == '*') {
+            return 1;
+        }
+        if (strncmp(p, "W/", 2) == 0) {
+            p += 2;
+        }
+        length = strcspn(p, ", ");
+        if (length == etag_length && strncmp(p, etag, length) == 0) {
+            return 1;
+        }
+        p += length;
+    }
+    return 0;
+}
 
-    // Compile a regex to match the request line
-    response_status = regcomp(
-        &request_regex, "([A-Z]{1,8}) /([A-Za-z0-9.]{2,64}) (HTTP/[0-9].[0-9])\r\n", REG_EXTENDED);
+// Whether a conditional GET or HEAD can be answered with 304 Not Modified. If-None-Match
+// wins over If-Modified-Since when both are sent, and an unparseable date is ignored.
+int not_modified(const request_t *request, const char *etag, time_t mtime) {
+    struct tm tm = { 0 };
+    const char *end;
 
-    // Execute the regex on the request to check if it matches the request formatting
-    response_status = regexec(&request_regex, request_buffer, 4, request_matches, 0);
+    if (request->if_none_match != NULL) {
+        return etag_matches(request->if_none_match, etag);
+    }
+    if (request->if_modified_since != NULL) {
+        end = strptime(request->if_modified_since, HTTP_DATE_FORMAT, &tm);
+        return end != NULL && *end == '\0' && mtime <= timegm(&tm);
+    }
+    return 0;
+}
 
-    // If the formatting doesn't match, send an error response
+// Note the status a request is answered with, for the metrics and the audit log. Requests
+// that take effect under a URI's lock are logged before it is released.
+void record_status(conn_t *conn, const request_t *request, int status) {
+    conn->status = status;
+    if (audit_log != NULL) {
+        auditlog_record(audit_log, request->method, request->uri, status, request->request_id);
+    }
+}
+
+// Answer a scrape of /metrics with the metrics in the Prometheus text format. Returns 0, or 1
+// if the response couldn't be sent.
+int send_metrics(conn_t *conn, const request_t *request) {
+    char header[MAX_REQUEST_BUFFER_SIZE];
+    size_t length;
+    int failed;
+    char *text
+        = metrics_render(server_metrics, queue_length(request_queue), worker_count, &length);
+
+    record_status(conn, request, 200);
+    snprintf(header, sizeof(header),
+        "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n\r\n",
+        length);
+    failed = send_bytes(conn->fd, header, strlen(header)) == -1
+             || (strcmp(request->method, "HEAD") != 0 && send_bytes(conn->fd, text, length) == -1);
+    free(text);
+    return failed;
+}
+
+// Handle the request buffered on a connection and send a response. Returns 0 if the
+// connection can go on to serve another request, or 1 if it must be closed.
+int handle_request(conn_t *conn) {
+    int fd = conn->fd;
+    struct stat file_info;
+    struct timespec deadline;
+    request_t request;
+    rwlock_t *lock;
+    cache_entry_t *entry;
+    int bytes_read, bytes_written, buffered_body, file_descriptor, content_length = 0;
+    int response_status, existing_file = 0, head, locked;
+    off_t file_size = 0, offset;
+    size_t count;
+    char etag[VALIDATOR_SIZE], last_modified[VALIDATOR_SIZE];
+    char temp_path[sizeof(PUT_TEMP_TEMPLATE)];
+    char response_buffer[MAX_REQUEST_BUFFER_SIZE];
+    char *request_buffer = conn->request_buffer;
+    char *method, *resource, *message_body;
+
+    bytes_read = conn->bytes_read;
+
+    // Null-terminate the request
+    request_buffer[bytes_read] = '\0';
+
+    // Parse the request line and headers
+    response_status = request_parse(request_buffer, &request);
     if (response_status != 0) {
-        send_error_response(fd, 400);
-        regfree(&request_regex);
+        conn->method = NULL;
+        conn->status = response_status;
+        conn->bytes_in = bytes_read;
+        send_error_response(fd, response_status);
         return 1;
     }
 
-    // Use regex matches to extract parts of the request
-    method = request_buffer + request_matches[1].rm_so;
-    resource = request_buffer + request_matches[2].rm_so;
-    http_version = request_buffer + request_matches[3].rm_so;
+    method = request.method;
+    resource = request.uri;
+    content_length = request.content_length;
+    if (!request.keep_alive) {
+        conn->keep_alive = 0;
+    }
 
-    // Null-terminate the extracted parts
-    request_buffer[request_matches[1].rm_eo] = '\0';
-    request_buffer[request_matches[2].rm_eo] = '\0';
-    request_buffer[request_matches[3].rm_eo] = '\0';
+    // Anything in the buffer past the body belongs to the next pipelined request
+    message_body = request.body;
+    buffered_body = bytes_read - (int) (message_body - request_buffer);
+    if (buffered_body > content_length) {
+        buffered_body = content_length;
+    }
+    conn->request_length = (int) (message_body - request_buffer) + buffered_body;
+    conn->method = method;
+    conn->bytes_in = (message_body - request_buffer) + content_length;
 
-    // Check if the HTTP version is not HTTP/1.1
-    if (strcmp(http_version, "HTTP/1.1") != 0) {
-        send_error_response(fd, 505);
-        return 1;
+    // A body on any other method is skipped, which only works if it is already buffered
+    if (strcmp(method, "PUT") != 0 && buffered_body < content_length) {
+        conn->keep_alive = 0;
     }
 
-    // Create a new regex for header lines
-    response_status
-        = regcomp(&request_regex, "([A-Za-z0-9.-]{1,128}): ([ -~]{0,128})", REG_EXTENDED);
+    // While metrics are enabled they are served in place of any file named "metrics"
+    if (server_metrics != NULL && strcmp(resource, "metrics") == 0
+        && (strcmp(method, "GET") == 0 || strcmp(method, "HEAD") == 0)) {
+        return send_metrics(conn, &request);
+    }
 
-    // Set the headers pointer (headers) to point to the beginning of headers
-    headers = request_buffer + request_matches[3].rm_eo + 2;
+    // If the request is a GET or HEAD request; HEAD gets the same header with no body
+    if (strcmp(method, "GET") == 0 || strcmp(method, "HEAD") == 0) {
+        head = strcmp(method, "HEAD") == 0;
 
-    // Loop until the end of headers is reached
-    while (headers[0] != '\r' || headers[1] != '\n') {
-        // Execute regex on the header line to make sure it matches formatting
-        response_status = regexec(&request_regex, headers, 4, request_matches, 0);
-        if (response_status != 0) {
-            send_error_response(fd, 400);
-            regfree(&request_regex);
-            return 1;
+        // Open the resource under its read lock; a later PUT renames a new file into place, so
+        // the descriptor keeps referring to this version and the transfer needs no lock
+        lock = locktable_acquire(uri_locks, resource);
+        lock_deadline(&deadline);
+        metrics_lock_begin(server_metrics);
+        locked = reader_timedlock(lock, &deadline);
+        metrics_lock_end(server_metrics, false, rwlock_last_wait_ns());
+        if (!locked) {
+            // A writer has held the resource for as long as we would wait on the socket
+            locktable_release(uri_locks, resource);
+            record_status(conn, &request, 503);
+            if (head) {
+                send_error_head(fd, 503);
+            } else {
+                send_error_response(fd, 503);
+            }
+            return 0;
         }
 
-        // Use regex matches to extract the key and value of the header
-        key = headers + request_matches[1].rm_so;
-        value = headers + request_matches[2].rm_so;
+        response_status = 200;
+        file_descriptor = -1;
+        entry = NULL;
 
-        // Null-terminate the extracted parts
-        headers[request_matches[1].rm_eo] = '\0';
-        headers[request_matches[2].rm_eo] = '\0';
+        // Hot files are served from memory while the cached copy is still current
+        if (file_cache != NULL) {
+            entry = cache_lookup(file_cache, resource);
+        }
+
+        if (entry == NULL) {
+            file_descriptor = open(resource, O_RDONLY);
+            if (file_descriptor == -1) {
+                if (errno == ENOENT) {
+                    response_status = 404;
+                } else if (errno == EACCES) {
+                    response_status = 403;
+                } else {
+                    response_status = 500;
+                }
+            } else if (fstat(file_descriptor, &file_info) == -1) {
+                response_status = 500;
+            } else if (S_ISDIR(file_info.st_mode) != 0) {
+                response_status = 403;
+            } else {
+                file_validators(etag, last_modified, file_info.st_ino, file_info.st_size,
+                    &(file_info.st_mtim));
+                sprintf(response_buffer,
+                    "HTTP/1.1 200 OK\r\nContent-Length: %lu\r\nETag: %s\r\n"
+                    "Last-Modified: %s\r\n\r\n",
+                    file_info.st_size, etag, last_modified);
 
-        // Check if the key is "Content-Length"
-        if (strcmp(key, "Content-Length") == 0) {
-            // Check whether content length is greater than 0, else send an error response
-            content_length = atoi(value);
-            if (content_length <= 0) {
-                send_error_response(fd, 400);
-                regfree(&request_regex);
-                return 1;
+                // Small files are read into the cache while the read lock keeps PUTs out, so
+                // the entry can't be older than a PUT that has already invalidated the URI
+                if (file_cache != NULL) {
+                    entry = cache_insert(file_cache, resource, &file_info, response_buffer,
+                        strlen(response_buffer), file_descriptor);
+                }
             }
+        } else {
+            // The cached header carries the same validators, worked out when it was filled
+            file_validators(etag, last_modified, entry->ino, entry->size, &(entry->mtime));
         }
 
-        // Move to the next iteration in the header line
-        headers = headers + request_matches[2].rm_eo + 2;
-    }
+        // Settle the response while the lock is still held, so the audit log sees it in the
+        // order the resource's operations took effect. A client whose copy is still current
+        // gets the validators without the body; this is decided before any Range, which only
+        // applies to a response that sends the file. HTTP has HEAD ignore Range.
+        offset = 0;
+        count = 0;
+        if (response_status == 200
+            && not_modified(&request, etag,
+                entry != NULL ? entry->mtime.tv_sec : file_info.st_mtim.tv_sec)) {
+            response_status = 304;
+        } else if (response_status == 200 && !head) {
+            file_size = entry != NULL ? (off_t) (entry->length - entry->header_length)
+                                      : file_info.st_size;
+            response_status = request_range(&request, file_size, &offset, &count);
+        }
+        record_status(conn, &request, response_status);
 
-    regfree(&request_regex);
+        reader_unlock(lock);
+        locktable_release(uri_locks, resource);
 
-    // If the request is a GET request
-    if (strcmp(method, "GET") == 0) {
-        if (stat(resource, &file_info) == -1) {
-            if (errno == ENOENT) {
-                send_error_response(fd, 404);
-            } else if (errno == EACCES) {
-                send_error_response(fd, 403);
+        if (response_status == 304) {
+            if (file_descriptor != -1) {
+                close(file_descriptor);
+            }
+            if (entry != NULL) {
+                cache_release(entry);
+            }
+            sprintf(response_buffer,
+                "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nLast-Modified: %s\r\n\r\n", etag,
+                last_modified);
+            return send_bytes(fd, response_buffer, strlen(response_buffer)) == -1;
+        }
+
+        // The request itself was fine, so the connection can carry on after the error
+        if (response_status != 200 && response_status != 206) {
+            if (file_descriptor != -1) {
+                close(file_descriptor);
+            }
+            if (entry != NULL) {
+                cache_release(entry);
+            }
+            if (response_status == 416) {
+                // Tell the client how long the file is so it can ask again
+                sprintf(response_buffer,
+                    "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Length: 22\r\n"
+                    "Content-Range: bytes */%ld\r\n\r\nRange Not Satisfiable\n",
+                    (long) file_size);
+                return send_bytes(fd, response_buffer, strlen(response_buffer)) == -1;
+            } else if (head) {
+                send_error_head(fd, response_status);
             } else {
-                send_error_response(fd, 500);
+                send_error_response(fd, response_status);
             }
+            return response_status == 500;
         }
-        if (S_ISDIR(file_info.st_mode) != 0) {
-            send_error_response(fd, 403);
+
+        if (response_status == 206) {
+            sprintf(response_buffer,
+                "HTTP/1.1 206 Partial Content\r\nContent-Length: %zu\r\n"
+                "Content-Range: bytes %ld-%ld/%ld\r\nETag: %s\r\nLast-Modified: %s\r\n\r\n",
+                count, (long) offset, (long) (offset + count - 1), (long) file_size, etag,
+                last_modified);
         }
-        file_descriptor = open(resource, O_RDONLY);
-        if (file_descriptor < 0) {
-            if (errno == EACCES) {
-                send_error_response(fd, 403);
+
+        if (entry != NULL) {
+            // The cached response already holds the header and the content
+            if (file_descriptor != -1) {
+                close(file_descriptor);
+            }
+            if (head) {
+                response_status = send_bytes(fd, entry->data, entry->header_length) == -1;
+            } else if (response_status == 206) {
+                response_status
+                    = send_bytes(fd, response_buffer, strlen(response_buffer)) == -1
+                      || send_bytes(fd, entry->data + entry->header_length + offset, count)
+                             == -1;
+            } else {
+                response_status = send_bytes(fd, entry->data, entry->length) == -1;
             }
+            cache_release(entry);
+        } else {
+            // Only the requested bytes are sent, straight from their offset in the file
+            response_status = send_bytes(fd, response_buffer, strlen(response_buffer)) == -1
+                              || (!head && send_file(fd, file_descriptor, offset, count) == -1);
+            close(file_descriptor);
+        }
+
+        // The client stalled or went away mid-response, so the connection can't be reused
+        if (response_status != 0) {
+            return 1;
         }
-        sprintf(
-            response_buffer, "HTTP/1.1 200 OK\r\nContent-Length: %lu\r\n\r\n", file_info.st_size);
-        write_n_bytes(fd, response_buffer, strlen(response_buffer));
-        pass_n_bytes(file_descriptor, fd, file_info.st_size);
-        close(file_descriptor);
     }
     // If the request is a PUT request
     else if (strcmp(method, "PUT") == 0) {
-        response_status = stat(resource, &file_info);
-        if (response_status == 0) {
-            existing_file = 1;
+        if (content_length <= 0) {
+            record_status(conn, &request, 400);
+            send_error_response(fd, 400);
+            return 1;
         }
-        file_descriptor = open(resource, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+
+        // Stream the body into a temp file in the same directory, without holding any lock
+        strcpy(temp_path, PUT_TEMP_TEMPLATE);
+        file_descriptor = mkstemp(temp_path);
         if (file_descriptor == -1) {
-            if (errno == EACCES) {
-                send_error_response(fd, 403);
-            }
+            response_status = errno == EACCES ? 403 : 500;
+            record_status(conn, &request, response_status);
+            send_error_response(fd, response_status);
+            return 1;
+        }
+        fchmod(file_descriptor, 0644);
+
+        // Part of the body may have arrived along with the headers; write that first and splice
+        // the rest straight from the socket
+        bytes_written = buffered_body;
+        if (write_n_bytes(file_descriptor, message_body, bytes_written) != bytes_written
+            || receive_file(fd, file_descriptor, content_length - bytes_written) == -1) {
+            // The client went away or timed out; never publish a partial upload
+            close(file_descriptor);
+            unlink(temp_path);
+            record_status(conn, &request, 400);
+            send_error_response(fd, 400);
+            return 1;
+        }
+        close(file_descriptor);
+
+        // Commit the upload: the existence check runs as the upgradable reader, alongside GETs,
+        // and only the rename is exclusive. Nothing can change the resource in between.
+        lock = locktable_acquire(uri_locks, resource);
+        metrics_lock_begin(server_metrics);
+        upgradable_lock(lock);
+        metrics_lock_end(server_metrics, false, rwlock_last_wait_ns());
+
+        existing_file = stat(resource, &file_info) == 0;
+        metrics_lock_begin(server_metrics);
+        upgradable_upgrade(lock);
+        metrics_lock_end(server_metrics, true, rwlock_last_wait_ns());
+        response_status = rename(temp_path, resource);
+        if (response_status == -1) {
+            response_status = (errno == EACCES || errno == EISDIR) ? 403 : 500;
+        } else if (file_cache != NULL) {
+            cache_invalidate(file_cache, resource);
+        }
+        record_status(
+            conn, &request, response_status != 0 ? response_status : (existing_file ? 200 : 201));
+
+        writer_unlock(lock);
+        locktable_release(uri_locks, resource);
+
+        if (response_status != 0) {
+            unlink(temp_path);
+            send_error_response(fd, response_status);
             return 1;
         }
-        bytes_written = (int) (bytes_read + request_buffer - message_body);
-        response_status = write_n_bytes(file_descriptor, message_body, bytes_written);
-        pass_n_bytes(fd, file_descriptor, content_length - bytes_written);
+
         if (existing_file == 1) {
             sprintf(response_buffer, "HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\nOK\n");
-            response_status = write_n_bytes(fd, response_buffer, strlen(response_buffer));
+            response_status = send_bytes(fd, response_buffer, strlen(response_buffer));
         } else {
             sprintf(response_buffer, "HTTP/1.1 201 Created\r\nContent-Length: 8\r\n\r\nCreated\n");
-            response_status = write_n_bytes(fd, response_buffer, strlen(response_buffer));
+            response_status = send_bytes(fd, response_buffer, strlen(response_buffer));
         }
-        close(file_descriptor);
     } else {
+        record_status(conn, &request, 501);
         send_error_response(fd, 501);
         return 1;
     }
     return 0;
 }
 
+// Seconds on the monotonic clock, for idle timeouts
+time_t monotonic_seconds(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+// Give an idle keep-alive connection back to the event loop so it stops occupying a worker
+void conn_handback(conn_t *conn) {
+    uint64_t one = 1;
+
+    fcntl(conn->fd, F_SETFL, fcntl(conn->fd, F_GETFL) | O_NONBLOCK);
+
+    pthread_mutex_lock(&handback_mutex);
+    conn->next = handback_list;
+    handback_list = conn;
+    pthread_mutex_unlock(&handback_mutex);
+
+    // Wake the event loop so it starts watching the connection again
+    if (write(handback_fd, &one, sizeof(one)) == -1) {
+        fprintf(stderr, "Failed to wake the event loop\n");
+    }
+}
+
+// Serve requests on a connection, in order, until the client or an error closes it. In
+// event-driven mode the connection goes back to the event loop as soon as it runs out of
+// buffered requests; in threaded mode the worker waits for the next one (up to the socket
+// timeout).
+void serve_connection(conn_t *conn) {
+    uint64_t start, sent;
+    int result;
+
+    while (1) {
+        if (conn->state == CONN_READING) {
+            result = conn_fill(conn);
+            if (result != 1) {
+                // A timeout in the middle of a request, or before the first one, is answered
+                if (result == 0 && (conn->bytes_read > 0 || conn->requests == 0)) {
+                    send_error_response(conn->fd, 400);
+                }
+                conn_free(conn);
+                return;
+            }
+        }
+
+        start = metrics_request_begin(server_metrics);
+        sent = bytes_sent;
+        result = handle_request(conn);
+        metrics_request_end(server_metrics, conn->method, conn->status, conn->bytes_in,
+            bytes_sent - sent, start);
+
+        if (result != 0 || !conn->keep_alive || shutting_down) {
+            conn_free(conn);
+            return;
+        }
+
+        conn_next_request(conn);
+        conn_scan(conn);
+
+        if (event_driven && conn->state == CONN_READING) {
+            conn_handback(conn);
+            return;
+        }
+    }
+}
+
+// Record a SIGINT/SIGTERM so the dispatcher can shut the server down cleanly
+void handle_signal(int signum) {
+    (void) signum;
+    shutting_down = 1;
+}
+
+// Worker thread: pop connections off the request queue and serve them
+void *worker_thread(void *arg) {
+    void *element;
+    conn_t *conn;
+    uint64_t wait_start;
+
+    (void) arg;
+
+    while (1) {
+        // Only a pop that finds the queue empty is timed, as time spent waiting for work
+        wait_start = 0;
+        if (!queue_try_pop(request_queue, &element)) {
+            wait_start = metrics_queue_wait_begin(server_metrics);
+            if (!queue_pop(request_queue, &element)) {
+                break;
+            }
+        }
+        conn = (conn_t *) element;
+
+        // NULL is the sentinel pushed by main() during shutdown
+        if (conn == NULL) {
+            break;
+        }
+        metrics_queue_pop(server_metrics, wait_start);
+
+        serve_connection(conn);
+    }
+
+    close_splice_pipe();
+    return NULL;
+}
+
+// Give a socket the usual timeout for blocking reads and writes, so a client that stops
+// reading can't hold a worker in write() or sendfile() forever
+void set_timeouts(int fd) {
+    struct timeval timeout = { .tv_sec = SOCKET_TIMEOUT, .tv_usec = 0 };
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+// Turn off Nagle's algorithm on an accepted socket. A response goes out as a header write and
+// then the body; with Nagle on, the body waits for the client to ACK the header, which a
+// client delaying its ACKs holds back for ~40 ms on every kept-alive request.
+void set_nodelay(int fd) {
+    int one = 1;
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// Switch a socket handed over by the event loop back to blocking I/O with the usual timeouts
+void set_blocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    set_timeouts(fd);
+}
+
+// Add a connection to the front of the event loop's list, marking it as just active
+void conn_list_add(conn_list_t *list, conn_t *conn) {
+    conn->last_active = monotonic_seconds();
+    conn->prev = NULL;
+    conn->next = list->head;
+    if (list->head != NULL) {
+        list->head->prev = conn;
+    } else {
+        list->tail = conn;
+    }
+    list->head = conn;
+}
+
+// Remove a connection from the event loop's list
+void conn_list_remove(conn_list_t *list, conn_t *conn) {
+    if (conn->prev != NULL) {
+        conn->prev->next = conn->next;
+    } else {
+        list->head = conn->next;
+    }
+    if (conn->next != NULL) {
+        conn->next->prev = conn->prev;
+    } else {
+        list->tail = conn->prev;
+    }
+    conn->prev = NULL;
+    conn->next = NULL;
+}
+
+// Event-driven front end: a single thread accepts non-blocking sockets and reads request
+// headers from all of them with epoll, handing only complete requests to the workers. Idle
+// connections, including keep-alive connections the workers hand back, are closed after
+// IDLE_TIMEOUT seconds without activity.
+void event_loop(Listener_Socket *server_socket) {
+    struct epoll_event event, events[MAX_EVENTS];
+    conn_list_t connections = { NULL, NULL };
+    conn_t *conn, *returned;
+    void *batch[MAX_EVENTS];
+    struct timespec no_wait = { 0, 0 };
+    uint64_t wakeups;
+    time_t now;
+    int epoll_fd, ready, client_fd, batched, queued, pushed;
+
+    epoll_fd = epoll_create1(0);
+    handback_fd = eventfd(0, EFD_NONBLOCK);
+    if (epoll_fd == -1 || handback_fd == -1) {
+        fprintf(stderr, "Failed to create epoll instance\n");
+        exit(1);
+    }
+
+    // The listening socket and the handback eventfd are registered with pointers to their
+    // descriptors to tell them apart from client connections
+    fcntl(server_socket->fd, F_SETFL, fcntl(server_socket->fd, F_GETFL) | O_NONBLOCK);
+    event.events = EPOLLIN;
+    event.data.ptr = &(server_socket->fd);
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_socket->fd, &event);
+    event.data.ptr = &handback_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, handback_fd, &event);
+
+    while (!shutting_down) {
+        // Wake up at least once a second to close idle connections
+        ready = epoll_wait(epoll_fd, events, MAX_EVENTS, 1000);
+        if (ready == -1) {
+            // Interrupted by a signal; the loop condition checks for shutdown
+            continue;
+        }
+
+        batched = 0;
+        for (int i = 0; i < ready; i++) {
+            // Accept every pending connection and start watching it for request bytes
+            if (events[i].data.ptr == &(server_socket->fd)) {
+                while ((client_fd = accept4(server_socket->fd, NULL, NULL, SOCK_NONBLOCK)) != -1) {
+                    set_nodelay(client_fd);
+                    conn = conn_new(client_fd);
+                    if (conn == NULL) {
+                        close(client_fd);
+                        continue;
+                    }
+                    event.events = EPOLLIN;
+                    event.data.ptr = conn;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &event);
+                    conn_list_add(&connections, conn);
+                }
+                continue;
+            }
+
+            // Start watching the keep-alive connections workers have finished with
+            if (events[i].data.ptr == &handback_fd) {
+                if (read(handback_fd, &wakeups, sizeof(wakeups)) == -1) {
+                    continue;
+                }
+                pthread_mutex_lock(&handback_mutex);
+                returned = handback_list;
+                handback_list = NULL;
+                pthread_mutex_unlock(&handback_mutex);
+
+                while (returned != NULL) {
+                    conn = returned;
+                    returned = returned->next;
+                    event.events = EPOLLIN;
+                    event.data.ptr = conn;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->fd, &event);
+                    conn_list_add(&connections, conn);
+                }
+                continue;
+            }
+
+            // Parse whatever arrived; only complete requests leave the event loop
+            conn = (conn_t *) events[i].data.ptr;
+            conn_list_remove(&connections, conn);
+            switch (conn_fill(conn)) {
+            case 0: conn_list_add(&connections, conn); break;
+            case 1:
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+                set_blocking(conn->fd);
+                batch[batched++] = conn;
+                break;
+            default:
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+                conn_free(conn);
+                break;
+            }
+        }
+
+        // Hand this round's complete requests to the workers in as few queue operations as
+        // possible, without waiting. If the workers are saturated, shed the rest with a 503.
+        queued = 0;
+        while (queued < batched
+               && (pushed = queue_push_many(
+                       request_queue, batch + queued, batched - queued, &no_wait))
+                      > 0) {
+            queued += pushed;
+        }
+        if (queued > 0) {
+            metrics_queue_push(server_metrics, request_queue, queued);
+        }
+        for (int i = queued; i < batched; i++) {
+            conn = (conn_t *) batch[i];
+            metrics_shed(server_metrics);
+            send_error_response(conn->fd, 503);
+            conn_free(conn);
+        }
+
+        // The list is ordered by activity, so idle connections collect at the tail
+        now = monotonic_seconds();
+        while (connections.tail != NULL && now - connections.tail->last_active >= IDLE_TIMEOUT) {
+            conn = connections.tail;
+            conn_list_remove(&connections, conn);
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+            conn_free(conn);
+        }
+    }
+
+    // Drop the connections that are waiting for a request
+    while (connections.head != NULL) {
+        conn = connections.head;
+        conn_list_remove(&connections, conn);
+        conn_free(conn);
+    }
+    close(epoll_fd);
+}
+
 int main(int argc, char *argv[]) {
+    int opt;
     int port;
     int result;
+    int threads = DEFAULT_THREADS;
+    int cache_megabytes = 0;
+    int audit_fd = -1;
+    int metrics_enabled = 0;
+    pthread_t *workers;
+    sigset_t shutdown_signals;
+    struct sigaction action;
     Listener_Socket server_socket;
 
-    if (argc != 2) {
+    // Parse the optional thread count and front end
+    while ((opt = getopt(argc, argv, "c:el:mt:")) != -1) {
+        switch (opt) {
+        case 'c':
+            cache_megabytes = atoi(optarg);
+            if (cache_megabytes < 0) {
+                fprintf(stderr, "Invalid cache size\n");
+                exit(1);
+            }
+            break;
+        case 'e': event_driven = 1; break;
+        case 'l':
+            audit_fd = open(optarg, O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (audit_fd == -1) {
+                fprintf(stderr, "Failed to open audit log\n");
+                exit(1);
+            }
+            break;
+        case 'm': metrics_enabled = 1; break;
+        case 't':
+            threads = atoi(optarg);
+            if (threads < 1) {
+                fprintf(stderr, "Invalid number of threads\n");
+                exit(1);
+            }
+            break;
+        default:
+            fprintf(stderr,
+                "usage: %s [-c cache_mb] [-e] [-l audit_log] [-m] [-t threads] <port>\n",
+                argv[0]);
+            exit(1);
+        }
+    }
+
+    if (optind != argc - 1) {
         fprintf(stderr, "Invalid number of arguments\n");
         exit(1);
     }
 
-    port = atoi(argv[1]);
+    port = atoi(argv[optind]);
     if (port < 1 || port > 65535) {
         fprintf(stderr, "Invalid Port\n");
         exit(1);
     }
 
     result = listener_init(&server_socket, port);
-    if (result == 1) {
+    if (result == -1) {
         fprintf(stderr, "Failed to listen\n");
         exit(1);
     }
 
-    while (1) {
-        int client_fd = listener_accept(&server_socket);
-        if (client_fd == -1) {
-            continue;
+    // Writing to a socket the client already closed must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    // Install the shutdown handler without SA_RESTART so accept() is interrupted
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // Block the shutdown signals while spawning workers so only the dispatcher receives them
+    sigemptyset(&shutdown_signals);
+    sigaddset(&shutdown_signals, SIGINT);
+    sigaddset(&shutdown_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &shutdown_signals, NULL);
+
+    request_queue = queue_new(QUEUE_SIZE);
+    uri_locks = locktable_new(LOCK_TABLE_BUCKETS, N_WAY, LOCK_NWAY_READERS);
+    if (cache_megabytes > 0) {
+        file_cache = cache_new((size_t) cache_megabytes << 20, CACHE_MAX_OBJECT, CACHE_SHARDS);
+    }
+    if (audit_fd != -1) {
+        audit_log = auditlog_new(audit_fd);
+    }
+    if (metrics_enabled) {
+        server_metrics = metrics_new();
+    }
+    worker_count = threads;
+    workers = malloc(sizeof(pthread_t) * threads);
+    if (workers == NULL) {
+        fprintf(stderr, "Failed to allocate worker threads\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&workers[i], NULL, worker_thread, NULL) != 0) {
+            fprintf(stderr, "Failed to create worker thread\n");
+            exit(1);
         }
-        result = handle_request(client_fd);
-        close(client_fd);
     }
 
+    pthread_sigmask(SIG_UNBLOCK, &shutdown_signals, NULL);
+
+    if (event_driven) {
+        event_loop(&server_socket);
+    } else {
+        // Dispatcher: accept connections and hand them to the worker pool
+        while (!shutting_down) {
+            int client_fd = listener_accept(&server_socket);
+            if (client_fd == -1) {
+                continue;
+            }
+            set_timeouts(client_fd);
+            set_nodelay(client_fd);
+            conn_t *conn = conn_new(client_fd);
+            if (conn == NULL) {
+                close(client_fd);
+                continue;
+            }
+            // Shed load instead of blocking when every worker is busy and the queue is full
+            if (!queue_try_push(request_queue, conn)) {
+                metrics_shed(server_metrics);
+                send_error_response(client_fd, 503);
+                conn_free(conn);
+            } else {
+                metrics_queue_push(server_metrics, request_queue, 1);
+            }
+        }
+    }
+
+    // Let the workers drain the connections already queued, then stop them
+    for (int i = 0; i < threads; i++) {
+        queue_push(request_queue, NULL);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    // Close the keep-alive connections handed back after the event loop stopped
+    while (handback_list != NULL) {
+        conn_t *conn = handback_list;
+        handback_list = conn->next;
+        conn_free(conn);
+    }
+    if (handback_fd != -1) {
+        close(handback_fd);
+    }
+
+    // Every worker has stopped, so the whole log can be written out and synced
+    if (audit_log != NULL) {
+        auditlog_delete(&audit_log);
+        close(audit_fd);
+    }
+
+    free(workers);
+    metrics_delete(&server_metrics);
+    queue_delete(&request_queue);
+    locktable_delete(&uri_locks);
+    cache_delete(&file_cache);
+    close(server_socket.fd);
+
     return 0;
 }
@@ -0,0 +1,578 @@
+// Main File - loadgen.c
+// Ishika Pol - CSE130
+// HTTP load generator for httpserver. Threads send a mix of GETs and PUTs over a set of files,
+// either as fast as the responses come back (closed loop) or at a fixed total rate (open loop),
+// and one CSV row is printed with the throughput and latency percentiles. Every PUT body
+// encodes its file and version, so each GET checks that it got one whole version of the right
+// file even while other threads are replacing it.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "futex.h"
+#include "histogram.h"
+
+#define DEFAULT_THREADS 4
+#define DEFAULT_DURATION_MS 2000
+#define DEFAULT_FILES 16
+#define DEFAULT_FILE_SIZE 4096
+#define DEFAULT_PUT_PERMILLE 100
+
+// Every body starts with "<file> <version>\n" in fixed-width hex, so it needs at least this much
+#define BODY_HEADER_LENGTH 26
+#define MIN_FILE_SIZE 32
+// Room for a request or response header
+#define HEADER_BUFFER_SIZE 4096
+
+typedef struct config {
+    int port;
+    int threads;
+    int duration_ms;
+    int files; // Number of files the requests are spread over
+    int file_size; // Bytes in every file
+    int put_permille; // PUTs per 1000 requests
+    double zipf; // Skew of the file choice: 0 for uniform, otherwise the zipf exponent
+    bool keep_alive; // Reuse each thread's connection rather than connecting per request
+    double rate; // Total requests per second in open-loop mode, 0 for closed loop
+} config_t;
+
+// Everything the threads share
+typedef struct shared {
+    config_t *config;
+    double *cdf; // Cumulative probability of each file being picked, when skewed
+    _Atomic uint64_t next_version; // Version for the next PUT
+    uint64_t start_ns; // When the run started and when it ends
+    uint64_t end_ns;
+} shared_t;
+
+// Per-thread state and results
+typedef struct worker {
+    shared_t *shared;
+    pthread_t thread;
+    int index;
+    uint64_t rng; // xorshift64 state
+    int fd; // The connection, or -1 if there is none
+    uint64_t fd_requests; // Requests sent on the current connection
+    char *send_buffer; // Request header followed by the PUT body
+    char *body; // Body of the last response
+    char *expected; // What a GET body should be, rebuilt from its version
+    char header[HEADER_BUFFER_SIZE + 1]; // Bytes received but not yet consumed
+    size_t header_length;
+    uint64_t requests, gets, puts;
+    uint64_t errors; // Failed connections and unexpected statuses
+    uint64_t shed; // 503s
+    uint64_t inconsistent; // GETs whose body wasn't one whole version of the file
+    uint64_t connects;
+    uint64_t hist[BUCKETS]; // Latency from sending each request
+    uint64_t corrected[BUCKETS]; // Latency from when each request was due to be sent
+} worker_t;
+
+uint64_t next_random(worker_t *w) {
+    w->rng ^= w->rng << 13;
+    w->rng ^= w->rng >> 7;
+    w->rng ^= w->rng << 17;
+    return w->rng;
+}
+
+// Pick the file for the next request, uniformly or from the zipf distribution
+int pick_file(worker_t *w) {
+    shared_t *s = w->shared;
+    int low = 0, high = s->config->files - 1;
+
+    if (s->cdf == NULL) {
+        return (int) (next_random(w) % s->config->files);
+    }
+
+    // Find the first file whose cumulative probability reaches u
+    double u = (next_random(w) >> 11) * 0x1p-53;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (s->cdf[mid] < u) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// The body of one version of a file: its file and version, then bytes that depend on both
+// and on their position, so no two versions share a body and a body spliced from two
+// versions can't pass for either
+void fill_body(char *body, int size, int file, uint64_t version) {
+    char header[BODY_HEADER_LENGTH + 1];
+
+    snprintf(header, sizeof(header), "%08x %016lx\n", (unsigned) file, (unsigned long) version);
+    memcpy(body, header, BODY_HEADER_LENGTH);
+    for (int i = BODY_HEADER_LENGTH; i < size; i++) {
+        uint64_t x = (version + 1) * 0x9E3779B97F4A7C15ull ^ (uint64_t) i * 0xBF58476D1CE4E5B9ull;
+        body[i] = (char) ('a' + (x >> 60));
+    }
+}
+
+// Check that a GET body is one whole version of the file that some PUT wrote
+bool body_consistent(worker_t *w, size_t length, int file) {
+    config_t *c = w->shared->config;
+    unsigned body_file;
+    unsigned long version;
+
+    if (length != (size_t) c->file_size) {
+        return false;
+    }
+    w->body[BODY_HEADER_LENGTH - 1] = '\0';
+    if (sscanf(w->body, "%8x %16lx", &body_file, &version) != 2 || (int) body_file != file
+        || version >= atomic_load_explicit(&(w->shared->next_version), memory_order_relaxed)) {
+        return false;
+    }
+    w->body[BODY_HEADER_LENGTH - 1] = '\n';
+
+    fill_body(w->expected, c->file_size, file, version);
+    return memcmp(w->body, w->expected, c->file_size) == 0;
+}
+
+// Open a connection to the server on loopback
+int connect_server(int port) {
+    struct sockaddr_in addr = { 0 };
+    int fd = socket(AF_INET, SOCK_STREAM, 0), one = 1;
+
+    if (fd == -1) {
+        return -1;
+    }
+    // Requests are written whole, so don't let Nagle hold back the last segment
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Send n bytes, or return -1
+int send_all(int fd, const char *buf, size_t n) {
+    ssize_t sent;
+
+    while (n > 0) {
+        sent = send(fd, buf, n, MSG_NOSIGNAL);
+        if (sent == -1 && errno == EINTR) {
+            continue;
+        } else if (sent <= 0) {
+            return -1;
+        }
+        buf += sent;
+        n -= sent;
+    }
+    return 0;
+}
+
+// Receive more bytes after the ones already buffered; returns the count, or -1 on EOF or error
+ssize_t receive(int fd, char *buf, size_t n) {
+    ssize_t received;
+
+    do {
+        received = recv(fd, buf, n, 0);
+    } while (received == -1 && errno == EINTR);
+    return received > 0 ? received : -1;
+}
+
+// Read one response: the status, whether the server will close the connection after it, and
+// the body into w->body (cut off at the file size). Returns the body length, or -1 if the
+// connection failed or the response was malformed.
+ssize_t read_response(worker_t *w, int *status, bool *closing) {
+    size_t capacity = w->shared->config->file_size, header_end, content_length = 0, have, copied;
+    char *end, *field;
+    char discard[HEADER_BUFFER_SIZE];
+    ssize_t received;
+
+    // Read until the blank line that ends the header
+    while ((end = memmem(w->header, w->header_length, "\r\n\r\n", 4)) == NULL) {
+        if (w->header_length == HEADER_BUFFER_SIZE) {
+            return -1;
+        }
+        received
+            = receive(w->fd, w->header + w->header_length, HEADER_BUFFER_SIZE - w->header_length);
+        if (received == -1) {
+            return -1;
+        }
+        w->header_length += received;
+    }
+    header_end = end + 4 - w->header;
+    *end = '\0';
+
+    if (sscanf(w->header, "HTTP/1.1 %d", status) != 1) {
+        return -1;
+    }
+    *closing = strcasestr(w->header, "\r\nConnection: close") != NULL;
+    field = strcasestr(w->header, "\r\nContent-Length: ");
+    if (field != NULL) {
+        content_length = strtoul(field + 18, NULL, 10);
+    }
+
+    // Whatever of the body came in with the header, then the rest straight from the socket
+    have = w->header_length - header_end;
+    if (have > content_length) {
+        have = content_length;
+    }
+    copied = have < capacity ? have : capacity;
+    memcpy(w->body, w->header + header_end, copied);
+    memmove(w->header, w->header + header_end + have, w->header_length - header_end - have);
+    w->header_length -= header_end + have;
+
+    while (have < content_length) {
+        if (copied < capacity) {
+            received = receive(w->fd, w->body + copied, content_length - have < capacity - copied
+                                                            ? content_length - have
+                                                            : capacity - copied);
+            copied += received > 0 ? received : 0;
+        } else {
+            received = receive(w->fd, discard,
+                content_length - have < sizeof(discard) ? content_length - have : sizeof(discard));
+        }
+        if (received == -1) {
+            return -1;
+        }
+        have += received;
+    }
+
+    return (ssize_t) content_length;
+}
+
+void close_connection(worker_t *w) {
+    if (w->fd != -1) {
+        close(w->fd);
+        w->fd = -1;
+    }
+    w->header_length = 0;
+}
+
+// Send one request and read its response, over the worker's connection if it has one.
+// Returns the status, or -1 if the server couldn't be reached.
+int exchange(worker_t *w, int file, uint64_t version, bool put, ssize_t *length) {
+    config_t *c = w->shared->config;
+    int header_length, status;
+    bool closing;
+
+    const char *connection = c->keep_alive ? "" : "Connection: close\r\n";
+    if (put) {
+        header_length = snprintf(w->send_buffer, HEADER_BUFFER_SIZE,
+            "PUT /lg%d.dat HTTP/1.1\r\nContent-Length: %d\r\n%s\r\n", file, c->file_size,
+            connection);
+        fill_body(w->send_buffer + header_length, c->file_size, file, version);
+    } else {
+        header_length = snprintf(w->send_buffer, HEADER_BUFFER_SIZE,
+            "GET /lg%d.dat HTTP/1.1\r\n%s\r\n", file, connection);
+    }
+
+    // A kept-alive connection may have been closed by the server since its last request,
+    // so a failure on one is retried once on a fresh connection
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (w->fd == -1) {
+            w->fd = connect_server(c->port);
+            if (w->fd == -1) {
+                return -1;
+            }
+            w->fd_requests = 0;
+            w->connects++;
+        }
+        bool reused = w->fd_requests > 0;
+        w->fd_requests++;
+
+        if (send_all(w->fd, w->send_buffer, header_length + (put ? c->file_size : 0)) == 0
+            && (*length = read_response(w, &status, &closing)) != -1) {
+            // The server keeps the connection open after error statuses other than 500. When
+            // it does close one without saying so, the next request fails and is retried below.
+            if (!c->keep_alive || closing || status == 500) {
+                close_connection(w);
+            }
+            return status;
+        }
+        close_connection(w);
+        if (!reused) {
+            break;
+        }
+    }
+    return -1;
+}
+
+// Pick, send and check one request
+void one_request(worker_t *w) {
+    config_t *c = w->shared->config;
+    bool put = (int) (next_random(w) % 1000) < c->put_permille;
+    int file = pick_file(w), status;
+    uint64_t version = 0;
+    ssize_t length;
+
+    if (put) {
+        version = atomic_fetch_add_explicit(&(w->shared->next_version), 1, memory_order_relaxed);
+    }
+
+    status = exchange(w, file, version, put, &length);
+    w->requests++;
+    if (put) {
+        w->puts++;
+    } else {
+        w->gets++;
+    }
+
+    if (status == 503) {
+        w->shed++;
+    } else if (put ? status != 200 && status != 201 : status != 200) {
+        w->errors++;
+    } else if (!put && !body_consistent(w, length, file)) {
+        w->inconsistent++;
+    }
+}
+
+// Sleep until an absolute CLOCK_MONOTONIC time in nanoseconds
+void sleep_until(uint64_t ns) {
+    struct timespec ts = { .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+// Benchmark thread. In closed loop each request is sent as soon as the last one is answered,
+// until the run ends. In open loop requests are due at fixed intervals; one sent late because
+// the server was slow is timed from when it was due as well as from when it went out, so the
+// stall it waited through counts against the server (the coordinated-omission correction).
+void *worker_thread(void *arg) {
+    worker_t *w = (worker_t *) arg;
+    shared_t *s = w->shared;
+    config_t *c = s->config;
+    uint64_t interval = 0, due, sent, done;
+
+    if (c->rate > 0) {
+        interval = (uint64_t) (c->threads * 1e9 / c->rate);
+    }
+    // Stagger the threads' schedules so they don't all send at once
+    due = s->start_ns + interval * w->index / c->threads;
+
+    // In open loop every request due before the end is sent, even when a slow server pushes
+    // them past it, so the backlog it built up is measured rather than dropped
+    while (interval > 0 ? due < s->end_ns : monotonic_ns() < s->end_ns) {
+        if (interval > 0) {
+            sleep_until(due);
+        }
+
+        sent = monotonic_ns();
+        if (interval == 0) {
+            due = sent;
+        }
+        one_request(w);
+        done = monotonic_ns();
+
+        w->hist[bucket_of(done - sent)]++;
+        w->corrected[bucket_of(done - due)]++;
+        due += interval;
+    }
+
+    close_connection(w);
+    return NULL;
+}
+
+// Latency at a percentile of a merged histogram, in microseconds
+double percentile_us(const uint64_t *hist, uint64_t count, int permille) {
+    uint64_t seen = 0;
+
+    for (int j = 0; j < BUCKETS; j++) {
+        seen += hist[j];
+        if (count > 0 && seen * 1000 >= (uint64_t) permille * count) {
+            return bucket_limit(j) / 1e3;
+        }
+    }
+    return 0;
+}
+
+// Largest latency in a merged histogram, in microseconds
+double max_us(const uint64_t *hist) {
+    for (int j = BUCKETS - 1; j >= 0; j--) {
+        if (hist[j] > 0) {
+            return bucket_limit(j) / 1e3;
+        }
+    }
+    return 0;
+}
+
+worker_t *worker_new(shared_t *s, int index) {
+    worker_t *w = calloc(1, sizeof(worker_t));
+    if (w == NULL) {
+        fprintf(stderr, "Failed to allocate benchmark threads\n");
+        exit(1);
+    }
+    w->shared = s;
+    w->index = index;
+    w->rng = 0x9E3779B97F4A7C15ull * (index + 1);
+    w->fd = -1;
+    w->send_buffer = malloc(HEADER_BUFFER_SIZE + s->config->file_size);
+    w->body = malloc(s->config->file_size);
+    w->expected = malloc(s->config->file_size);
+    if (w->send_buffer == NULL || w->body == NULL || w->expected == NULL) {
+        fprintf(stderr, "Failed to allocate benchmark buffers\n");
+        exit(1);
+    }
+    return w;
+}
+
+void worker_delete(worker_t *w) {
+    free(w->send_buffer);
+    free(w->body);
+    free(w->expected);
+    free(w);
+}
+
+int main(int argc, char **argv) {
+    config_t c = { .port = 0,
+        .threads = DEFAULT_THREADS,
+        .duration_ms = DEFAULT_DURATION_MS,
+        .files = DEFAULT_FILES,
+        .file_size = DEFAULT_FILE_SIZE,
+        .put_permille = DEFAULT_PUT_PERMILLE,
+        .zipf = 0,
+        .keep_alive = true,
+        .rate = 0 };
+    shared_t s = { 0 };
+    bool header = false;
+    uint64_t hist[BUCKETS] = { 0 }, corrected[BUCKETS] = { 0 };
+    uint64_t requests = 0, gets = 0, puts = 0, errors = 0, shed = 0, inconsistent = 0;
+    uint64_t connects = 0;
+    int opt, status;
+    ssize_t length;
+
+    while ((opt = getopt(argc, argv, "cd:f:Hr:s:t:w:z:")) != -1) {
+        switch (opt) {
+        case 'c': c.keep_alive = false; break;
+        case 'd': c.duration_ms = atoi(optarg); break;
+        case 'f': c.files = atoi(optarg); break;
+        case 'H': header = true; break;
+        case 'r': c.rate = atof(optarg); break;
+        case 's': c.file_size = atoi(optarg); break;
+        case 't': c.threads = atoi(optarg); break;
+        case 'w': c.put_permille = atoi(optarg); break;
+        case 'z': c.zipf = atof(optarg); break;
+        default:
+            fprintf(stderr,
+                "usage: %s [-c] [-d ms] [-f files] [-H] [-r requests_per_sec] [-s file_size] "
+                "[-t threads] [-w puts_per_1000] [-z zipf_exponent] <port>\n",
+                argv[0]);
+            exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Invalid number of arguments\n");
+        exit(1);
+    }
+    c.port = atoi(argv[optind]);
+    if (c.port < 1 || c.port > 65535 || c.threads < 1 || c.duration_ms < 1 || c.files < 1
+        || c.file_size < MIN_FILE_SIZE || c.put_permille < 0 || c.put_permille > 1000
+        || c.zipf < 0 || c.rate < 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        exit(1);
+    }
+
+    s.config = &c;
+    atomic_init(&(s.next_version), 0);
+
+    // Probability of file k is proportional to 1 / (k + 1)^zipf
+    if (c.zipf > 0) {
+        double total = 0;
+        s.cdf = malloc(sizeof(double) * c.files);
+        if (s.cdf == NULL) {
+            fprintf(stderr, "Failed to allocate benchmark buffers\n");
+            exit(1);
+        }
+        for (int k = 0; k < c.files; k++) {
+            total += 1 / pow(k + 1, c.zipf);
+            s.cdf[k] = total;
+        }
+        for (int k = 0; k < c.files; k++) {
+            s.cdf[k] /= total;
+        }
+    }
+
+    // Give every file a first version, so GETs never find a file missing
+    worker_t *setup = worker_new(&s, c.threads);
+    for (int f = 0; f < c.files; f++) {
+        uint64_t version = atomic_fetch_add(&(s.next_version), 1);
+        status = exchange(setup, f, version, true, &length);
+        if (status != 200 && status != 201) {
+            fprintf(stderr, "Failed to create the benchmark files on port %d\n", c.port);
+            exit(1);
+        }
+    }
+    close_connection(setup);
+    worker_delete(setup);
+
+    worker_t **workers = malloc(sizeof(worker_t *) * c.threads);
+    if (workers == NULL) {
+        fprintf(stderr, "Failed to allocate benchmark threads\n");
+        exit(1);
+    }
+    s.start_ns = monotonic_ns();
+    s.end_ns = s.start_ns + (uint64_t) c.duration_ms * 1000000;
+    for (int i = 0; i < c.threads; i++) {
+        workers[i] = worker_new(&s, i);
+        pthread_create(&(workers[i]->thread), NULL, worker_thread, workers[i]);
+    }
+    for (int i = 0; i < c.threads; i++) {
+        pthread_join(workers[i]->thread, NULL);
+    }
+    double elapsed = (monotonic_ns() - s.start_ns) / 1e9;
+
+    for (int i = 0; i < c.threads; i++) {
+        worker_t *w = workers[i];
+        requests += w->requests;
+        gets += w->gets;
+        puts += w->puts;
+        errors += w->errors;
+        shed += w->shed;
+        inconsistent += w->inconsistent;
+        connects += w->connects;
+        for (int j = 0; j < BUCKETS; j++) {
+            hist[j] += w->hist[j];
+            corrected[j] += w->corrected[j];
+        }
+        worker_delete(w);
+    }
+    free(workers);
+    free(s.cdf);
+
+    if (header) {
+        printf("mode,threads,keep_alive,rate,put_permille,files,file_size,zipf,requests,gets,"
+               "puts,errors,shed,inconsistent,connects,requests_per_sec,p50_us,p99_us,p999_us,"
+               "max_us,corrected_p50_us,corrected_p99_us,corrected_p999_us,corrected_max_us\n");
+    }
+    printf("%s,%d,%d,%.0f,%d,%d,%d,%.2f,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%.0f,%.1f,%.1f,%.1f,%.1f,"
+           "%.1f,%.1f,%.1f,%.1f\n",
+        c.rate > 0 ? "open" : "closed", c.threads, c.keep_alive, c.rate, c.put_permille, c.files,
+        c.file_size, c.zipf, (unsigned long) requests, (unsigned long) gets, (unsigned long) puts,
+        (unsigned long) errors, (unsigned long) shed, (unsigned long) inconsistent,
+        (unsigned long) connects, requests / elapsed, percentile_us(hist, requests, 500),
+        percentile_us(hist, requests, 990), percentile_us(hist, requests, 999), max_us(hist),
+        percentile_us(corrected, requests, 500), percentile_us(corrected, requests, 990),
+        percentile_us(corrected, requests, 999), max_us(corrected));
+    fflush(stdout);
+
+    if (inconsistent > 0) {
+        fprintf(stderr, "%lu GETs returned a body that was not one whole version of the file\n",
+            (unsigned long) inconsistent);
+        return 2;
+    }
+    return 0;
+}
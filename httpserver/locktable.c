@@ -0,0 +1,167 @@
+// Main File - locktable.c
+// Ishika Pol - CSE130
+// Hash table of reference-counted reader-writer locks, one per URI in use, with a mutex per bucket.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "locktable.h"
+
+typedef struct entry {
+    char *uri; // URI this lock protects
+    int refcount; // Number of requests currently holding a reference
+    rwlock_t *lock; // The reader-writer lock handed out for the URI
+    struct entry *next; // Next entry in the same bucket
+} entry_t;
+
+typedef struct bucket {
+    pthread_mutex_t mutex; // Protects the entry list of this bucket
+    entry_t *head; // First entry in the bucket
+} bucket_t;
+
+typedef struct locktable {
+    int size; // Number of buckets
+    PRIORITY priority; // Priority of the rwlocks created by the table
+    uint32_t n; // N_WAY parameter of the rwlocks created by the table
+    bucket_t *buckets; // The array of buckets
+} locktable_t;
+
+// Hash a URI into a bucket index (djb2)
+static bucket_t *find_bucket(locktable_t *lt, const char *uri) {
+    unsigned long hash = 5381;
+
+    for (const char *c = uri; *c != '\0'; c++) {
+        hash = hash * 33 + (unsigned char) *c;
+    }
+
+    return &(lt->buckets[hash % lt->size]);
+}
+
+// Create a new lock table with the specified number of buckets
+locktable_t *locktable_new(int buckets, PRIORITY p, uint32_t n) {
+    locktable_t *lt = (locktable_t *) malloc(sizeof(locktable_t));
+    if (lt == NULL) {
+        fprintf(stderr, "Failed to allocate memory for lock table.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    lt->size = buckets;
+    lt->priority = p;
+    lt->n = n;
+
+    // Allocate the buckets and give each one its own mutex
+    lt->buckets = (bucket_t *) malloc(sizeof(bucket_t) * buckets);
+    if (lt->buckets == NULL) {
+        fprintf(stderr, "Failed to allocate memory for lock table.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < buckets; i++) {
+        pthread_mutex_init(&(lt->buckets[i].mutex), NULL);
+        lt->buckets[i].head = NULL;
+    }
+
+    return lt;
+}
+
+// Delete the lock table and release associated resources
+void locktable_delete(locktable_t **lt) {
+    if (lt == NULL || *lt == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < (*lt)->size; i++) {
+        bucket_t *bucket = &((*lt)->buckets[i]);
+
+        // Free any entries that were never released
+        while (bucket->head != NULL) {
+            entry_t *entry = bucket->head;
+            bucket->head = entry->next;
+            rwlock_delete(&(entry->lock));
+            free(entry->uri);
+            free(entry);
+        }
+        pthread_mutex_destroy(&(bucket->mutex));
+    }
+
+    free((*lt)->buckets);
+    free(*lt);
+    *lt = NULL;
+}
+
+// Find the lock for a URI, creating it if necessary, and take a reference on it
+rwlock_t *locktable_acquire(locktable_t *lt, const char *uri) {
+    bucket_t *bucket = find_bucket(lt, uri);
+    entry_t *entry;
+    rwlock_t *lock;
+
+    pthread_mutex_lock(&(bucket->mutex));
+
+    // Look for an existing entry for this URI
+    for (entry = bucket->head; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->uri, uri) == 0) {
+            break;
+        }
+    }
+
+    // No request is using this URI yet, so create a fresh lock for it
+    if (entry == NULL) {
+        entry = (entry_t *) malloc(sizeof(entry_t));
+        if (entry == NULL) {
+            fprintf(stderr, "Failed to allocate memory for lock table entry.\n");
+            exit(EXIT_FAILURE);
+        }
+        entry->uri = strdup(uri);
+        entry->refcount = 0;
+        entry->lock = rwlock_new(lt->priority, lt->n);
+        entry->next = bucket->head;
+        bucket->head = entry;
+    }
+
+    entry->refcount++;
+    lock = entry->lock;
+
+    pthread_mutex_unlock(&(bucket->mutex));
+
+    return lock;
+}
+
+// Drop a reference on the lock for a URI, freeing it when it is no longer in use
+void locktable_release(locktable_t *lt, const char *uri) {
+    bucket_t *bucket = find_bucket(lt, uri);
+    entry_t **link;
+    entry_t *entry = NULL;
+
+    pthread_mutex_lock(&(bucket->mutex));
+
+    // Find the entry along with the pointer that links to it
+    for (link = &(bucket->head); *link != NULL; link = &((*link)->next)) {
+        if (strcmp((*link)->uri, uri) == 0) {
+            entry = *link;
+            break;
+        }
+    }
+
+    if (entry == NULL) {
+        fprintf(stderr, "Error in locktable_release(). No lock for %s.\n", uri);
+        pthread_mutex_unlock(&(bucket->mutex));
+        return;
+    }
+
+    // Unlink the entry once the last reference is gone
+    entry->refcount--;
+    if (entry->refcount == 0) {
+        *link = entry->next;
+    } else {
+        entry = NULL;
+    }
+
+    pthread_mutex_unlock(&(bucket->mutex));
+
+    // Nobody can reach the entry any more, so it is safe to free it outside the bucket mutex
+    if (entry != NULL) {
+        rwlock_delete(&(entry->lock));
+        free(entry->uri);
+        free(entry);
+    }
+}
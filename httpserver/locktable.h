@@ -0,0 +1,62 @@
+/**
+ * @File locktable.h
+ *
+ * A table of reader/writer locks keyed by URI.  Every URI that is
+ * currently in use maps to exactly one rwlock_t; entries are reference
+ * counted and removed as soon as the last user releases them, so the
+ * table only ever holds locks for resources with requests in flight.
+ *
+ * @author Ishika Pol
+ */
+
+#pragma once
+
+#include "rwlock.h"
+
+/** @struct locktable_t
+ *
+ *  @brief This typedef renames the struct locktable.
+ */
+typedef struct locktable locktable_t;
+
+/** @brief Dynamically allocates and initializes a new lock table.
+ *
+ *  @param buckets the number of hash buckets.  Each bucket has its own
+ *         mutex, so lookups for URIs in different buckets never contend.
+ *
+ *  @param p the priority of the rwlocks handed out by the table.
+ *
+ *  @param n the n value for the rwlocks, if using N_WAY priority.
+ *
+ *  @return a pointer to a new locktable_t
+ */
+locktable_t *locktable_new(int buckets, PRIORITY p, uint32_t n);
+
+/** @brief Delete the lock table and free all of its memory.
+ *
+ *  @param lt the lock table to be deleted.  *lt is set to NULL on
+ *  return.  No locks may be acquired from the table at this point.
+ */
+void locktable_delete(locktable_t **lt);
+
+/** @brief Look up (or create) the rwlock for a URI and take a
+ *         reference on it.
+ *
+ *  @param lt the lock table.
+ *
+ *  @param uri the URI whose lock is wanted.
+ *
+ *  @return the rwlock for uri.  It stays valid until the matching
+ *          call to locktable_release().  Note, this does not lock the
+ *          rwlock; callers still use reader_lock()/writer_lock().
+ */
+rwlock_t *locktable_acquire(locktable_t *lt, const char *uri);
+
+/** @brief Drop a reference taken by locktable_acquire().  The entry
+ *         is freed once no references remain.
+ *
+ *  @param lt the lock table.
+ *
+ *  @param uri the URI passed to locktable_acquire().
+ */
+void locktable_release(locktable_t *lt, const char *uri);
@@ -0,0 +1,449 @@
+// Main File - metrics.c
+// Ishika Pol - CSE130
+// Per-thread request counters and latency histograms, summed into Prometheus text on demand.
+
+#include <stdalign.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "futex.h"
+#include "metrics.h"
+
+#define CACHE_LINE_SIZE 64
+
+// Latencies are counted in microseconds in a log-linear histogram: exact below 2 us, then two
+// buckets per power of two (upper bounds 1, 2, 3, 4, 6, 8, 12, 16, ... us). The last bucket
+// ends at about 67 s; anything slower only counts towards +Inf.
+#define SUB_BITS 1
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define BUCKETS 52
+
+// Methods and statuses get their own counters; anything else is counted as "other"
+static const char *method_names[] = { "GET", "HEAD", "PUT", "other" };
+#define METHODS ((int) (sizeof(method_names) / sizeof(method_names[0])))
+
+static const int statuses[]
+    = { 200, 201, 206, 304, 400, 403, 404, 416, 500, 501, 503, 505, 0 };
+#define STATUSES ((int) (sizeof(statuses) / sizeof(statuses[0])))
+
+// One thread's counters. Only the owning thread writes them, with a relaxed load and store
+// rather than an atomic add; they are atomic only so metrics_render() can read them while
+// they change.
+typedef struct thread_metrics {
+    alignas(CACHE_LINE_SIZE) _Atomic uint64_t requests[METHODS][STATUSES];
+    _Atomic uint64_t latency[METHODS][BUCKETS + 1]; // The last slot is past the last bucket
+    _Atomic uint64_t latency_us[METHODS]; // Sum of the latencies
+    _Atomic uint64_t bytes_in;
+    _Atomic uint64_t bytes_out;
+    _Atomic uint64_t lock_attempts[2]; // Read, then write
+    _Atomic uint64_t lock_waits[2]; // Attempts that had to sleep
+    _Atomic uint64_t lock_wait_ns[2];
+    _Atomic uint64_t shed;
+    _Atomic uint64_t queue_pushes; // Connections this thread pushed onto the worker queue
+    _Atomic uint64_t queue_high_water; // Deepest the queue was right after one of those pushes
+    _Atomic uint64_t queue_pops; // Connections this thread popped off the worker queue
+    _Atomic uint64_t queue_waits; // Pops that found the queue empty, and the time they slept
+    _Atomic uint64_t queue_wait_ns;
+    _Atomic uint32_t busy; // Gauges: handling a request, and waiting for a lock
+    _Atomic uint32_t waiting;
+    struct thread_metrics *next; // Next block in the list; fixed once the block is published
+} thread_metrics_t;
+
+typedef struct metrics {
+    _Atomic(thread_metrics_t *) threads; // Every thread's block, newest first
+} metrics_t;
+
+// The calling thread's block, and the metrics it was made for
+static _Thread_local thread_metrics_t *thread_block = NULL;
+static _Thread_local metrics_t *thread_owner = NULL;
+
+// Add to a counter only the calling thread writes
+static inline void bump(_Atomic uint64_t *counter, uint64_t n) {
+    atomic_store_explicit(
+        counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+static inline uint64_t read_counter(_Atomic uint64_t *counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+// Find the calling thread's block, creating and publishing it on first use
+static thread_metrics_t *thread_block_get(metrics_t *m) {
+    if (thread_owner == m) {
+        return thread_block;
+    }
+
+    thread_metrics_t *block = aligned_alloc(CACHE_LINE_SIZE, sizeof(thread_metrics_t));
+    if (block == NULL) {
+        fprintf(stderr, "Failed to allocate memory for metrics.\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(block, 0, sizeof(thread_metrics_t));
+
+    block->next = atomic_load_explicit(&(m->threads), memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(
+        &(m->threads), &(block->next), block, memory_order_release, memory_order_relaxed)) {
+    }
+
+    thread_block = block;
+    thread_owner = m;
+    return block;
+}
+
+// Histogram bucket for a latency, BUCKETS if it is past the last one
+static int bucket_of(uint64_t us) {
+    if (us < SUB_BUCKETS) {
+        return (int) us;
+    }
+    int msb = 63 - __builtin_clzll(us);
+    int sub = (int) ((us >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1));
+    int bucket = ((msb - SUB_BITS + 1) << SUB_BITS) + sub;
+    return bucket < BUCKETS ? bucket : BUCKETS;
+}
+
+// Smallest latency, in microseconds, past the end of a bucket
+static uint64_t bucket_bound(int bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket + 1;
+    }
+    int shift = (bucket >> SUB_BITS) - 1;
+    return (uint64_t) (SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1)) + 1) << shift;
+}
+
+static int method_index(const char *method) {
+    for (int i = 0; method != NULL && i < METHODS - 1; i++) {
+        if (strcmp(method, method_names[i]) == 0) {
+            return i;
+        }
+    }
+    return METHODS - 1;
+}
+
+static int status_index(int status) {
+    for (int i = 0; i < STATUSES - 1; i++) {
+        if (statuses[i] == status) {
+            return i;
+        }
+    }
+    return STATUSES - 1;
+}
+
+// Create an empty set of metrics
+metrics_t *metrics_new(void) {
+    metrics_t *m = malloc(sizeof(metrics_t));
+    if (m == NULL) {
+        fprintf(stderr, "Failed to allocate memory for metrics.\n");
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&(m->threads), NULL);
+    return m;
+}
+
+// Free the metrics and every thread's block
+void metrics_delete(metrics_t **m) {
+    if (m == NULL || *m == NULL) {
+        return;
+    }
+
+    thread_metrics_t *block = atomic_load_explicit(&((*m)->threads), memory_order_acquire);
+    while (block != NULL) {
+        thread_metrics_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(*m);
+    *m = NULL;
+}
+
+// Mark the thread busy and start timing a request
+uint64_t metrics_request_begin(metrics_t *m) {
+    if (m == NULL) {
+        return 0;
+    }
+    atomic_store_explicit(&(thread_block_get(m)->busy), 1, memory_order_relaxed);
+    return monotonic_ns();
+}
+
+// Count a finished request and its latency
+void metrics_request_end(metrics_t *m, const char *method, int status, uint64_t bytes_in,
+    uint64_t bytes_out, uint64_t start) {
+    if (m == NULL) {
+        return;
+    }
+
+    thread_metrics_t *block = thread_block_get(m);
+    int i = method_index(method);
+    uint64_t us = (monotonic_ns() - start) / 1000;
+
+    bump(&(block->requests[i][status_index(status)]), 1);
+    bump(&(block->latency[i][bucket_of(us)]), 1);
+    bump(&(block->latency_us[i]), us);
+    bump(&(block->bytes_in), bytes_in);
+    bump(&(block->bytes_out), bytes_out);
+    atomic_store_explicit(&(block->busy), 0, memory_order_relaxed);
+}
+
+// Mark the thread as trying for a lock
+void metrics_lock_begin(metrics_t *m) {
+    if (m != NULL) {
+        atomic_store_explicit(&(thread_block_get(m)->waiting), 1, memory_order_relaxed);
+    }
+}
+
+// Count a lock attempt and the sleep the lock's slow path timed for it
+void metrics_lock_end(metrics_t *m, bool write, uint64_t waited_ns) {
+    if (m == NULL) {
+        return;
+    }
+
+    thread_metrics_t *block = thread_block_get(m);
+    bump(&(block->lock_attempts[write]), 1);
+    if (waited_ns > 0) {
+        bump(&(block->lock_waits[write]), 1);
+        bump(&(block->lock_wait_ns[write]), waited_ns);
+    }
+    atomic_store_explicit(&(block->waiting), 0, memory_order_relaxed);
+}
+
+// Count a connection turned away
+void metrics_shed(metrics_t *m) {
+    if (m != NULL) {
+        bump(&(thread_block_get(m)->shed), 1);
+    }
+}
+
+// Count connections pushed onto the worker queue, and sample its depth afterwards
+void metrics_queue_push(metrics_t *m, queue_t *q, int n) {
+    if (m == NULL) {
+        return;
+    }
+
+    thread_metrics_t *block = thread_block_get(m);
+    uint64_t depth = queue_length(q);
+    bump(&(block->queue_pushes), n);
+    if (depth > read_counter(&(block->queue_high_water))) {
+        atomic_store_explicit(&(block->queue_high_water), depth, memory_order_relaxed);
+    }
+}
+
+// Start timing a pop that found the queue empty
+uint64_t metrics_queue_wait_begin(metrics_t *m) {
+    return m != NULL ? monotonic_ns() : 0;
+}
+
+// Count a connection popped off the worker queue, and the wait before it if there was one
+void metrics_queue_pop(metrics_t *m, uint64_t wait_start) {
+    if (m == NULL) {
+        return;
+    }
+
+    thread_metrics_t *block = thread_block_get(m);
+    bump(&(block->queue_pops), 1);
+    if (wait_start != 0) {
+        bump(&(block->queue_waits), 1);
+        bump(&(block->queue_wait_ns), monotonic_ns() - wait_start);
+    }
+}
+
+// A growing buffer of text
+typedef struct text {
+    char *data;
+    size_t length;
+    size_t capacity;
+} text_t;
+
+// Append formatted text, growing the buffer as needed
+static void text_printf(text_t *t, const char *format, ...) {
+    va_list args;
+    int n;
+
+    for (;;) {
+        va_start(args, format);
+        n = vsnprintf(t->data + t->length, t->capacity - t->length, format, args);
+        va_end(args);
+        if (n >= 0 && (size_t) n < t->capacity - t->length) {
+            t->length += n;
+            return;
+        }
+
+        t->capacity *= 2;
+        t->data = realloc(t->data, t->capacity);
+        if (t->data == NULL) {
+            fprintf(stderr, "Failed to allocate memory for metrics.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Sum every thread's counters and render them
+char *metrics_render(metrics_t *m, size_t queue_depth, int workers, size_t *length) {
+    static const char *modes[] = { "read", "write" };
+    uint64_t requests[METHODS][STATUSES] = { { 0 } };
+    uint64_t latency[METHODS][BUCKETS + 1] = { { 0 } };
+    uint64_t latency_us[METHODS] = { 0 };
+    uint64_t bytes_in = 0, bytes_out = 0, shed = 0;
+    uint64_t lock_attempts[2] = { 0 }, lock_waits[2] = { 0 }, lock_wait_ns[2] = { 0 };
+    uint64_t queue_pushes = 0, queue_pops = 0, queue_waits = 0, queue_wait_ns = 0;
+    uint64_t queue_high_water = 0, busy = 0, waiting = 0, count, cumulative;
+    text_t t = { .data = malloc(8192), .length = 0, .capacity = 8192 };
+
+    if (t.data == NULL) {
+        fprintf(stderr, "Failed to allocate memory for metrics.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    thread_metrics_t *block = m != NULL ? atomic_load_explicit(&(m->threads), memory_order_acquire)
+                                        : NULL;
+    for (; block != NULL; block = block->next) {
+        for (int i = 0; i < METHODS; i++) {
+            for (int j = 0; j < STATUSES; j++) {
+                requests[i][j] += read_counter(&(block->requests[i][j]));
+            }
+            for (int j = 0; j <= BUCKETS; j++) {
+                latency[i][j] += read_counter(&(block->latency[i][j]));
+            }
+            latency_us[i] += read_counter(&(block->latency_us[i]));
+        }
+        for (int i = 0; i < 2; i++) {
+            lock_attempts[i] += read_counter(&(block->lock_attempts[i]));
+            lock_waits[i] += read_counter(&(block->lock_waits[i]));
+            lock_wait_ns[i] += read_counter(&(block->lock_wait_ns[i]));
+        }
+        bytes_in += read_counter(&(block->bytes_in));
+        bytes_out += read_counter(&(block->bytes_out));
+        shed += read_counter(&(block->shed));
+        queue_pushes += read_counter(&(block->queue_pushes));
+        queue_pops += read_counter(&(block->queue_pops));
+        queue_waits += read_counter(&(block->queue_waits));
+        queue_wait_ns += read_counter(&(block->queue_wait_ns));
+        if (read_counter(&(block->queue_high_water)) > queue_high_water) {
+            queue_high_water = read_counter(&(block->queue_high_water));
+        }
+        busy += atomic_load_explicit(&(block->busy), memory_order_relaxed);
+        waiting += atomic_load_explicit(&(block->waiting), memory_order_relaxed);
+    }
+
+    text_printf(&t, "# HELP httpserver_requests_total Requests answered, by method and status.\n"
+                    "# TYPE httpserver_requests_total counter\n");
+    for (int i = 0; i < METHODS; i++) {
+        for (int j = 0; j < STATUSES; j++) {
+            if (requests[i][j] == 0) {
+                continue;
+            }
+            if (statuses[j] == 0) {
+                text_printf(&t, "httpserver_requests_total{method=\"%s\",status=\"other\"} %lu\n",
+                    method_names[i], (unsigned long) requests[i][j]);
+            } else {
+                text_printf(&t, "httpserver_requests_total{method=\"%s\",status=\"%d\"} %lu\n",
+                    method_names[i], statuses[j], (unsigned long) requests[i][j]);
+            }
+        }
+    }
+
+    // Prometheus buckets are cumulative: each counts every request up to its bound
+    text_printf(&t,
+        "# HELP httpserver_request_duration_seconds Time from a request's headers arriving to "
+        "the last byte of its response being sent.\n"
+        "# TYPE httpserver_request_duration_seconds histogram\n");
+    for (int i = 0; i < METHODS; i++) {
+        count = 0;
+        for (int j = 0; j <= BUCKETS; j++) {
+            count += latency[i][j];
+        }
+        if (count == 0) {
+            continue;
+        }
+        cumulative = 0;
+        for (int j = 0; j < BUCKETS; j++) {
+            cumulative += latency[i][j];
+            text_printf(&t,
+                "httpserver_request_duration_seconds_bucket{method=\"%s\",le=\"%.9g\"} %lu\n",
+                method_names[i], bucket_bound(j) / 1e6, (unsigned long) cumulative);
+        }
+        text_printf(&t,
+            "httpserver_request_duration_seconds_bucket{method=\"%s\",le=\"+Inf\"} %lu\n"
+            "httpserver_request_duration_seconds_sum{method=\"%s\"} %.6f\n"
+            "httpserver_request_duration_seconds_count{method=\"%s\"} %lu\n",
+            method_names[i], (unsigned long) count, method_names[i], latency_us[i] / 1e6,
+            method_names[i], (unsigned long) count);
+    }
+
+    text_printf(&t,
+        "# HELP httpserver_received_bytes_total Bytes of requests, headers and bodies.\n"
+        "# TYPE httpserver_received_bytes_total counter\n"
+        "httpserver_received_bytes_total %lu\n"
+        "# HELP httpserver_sent_bytes_total Bytes of responses, headers and bodies.\n"
+        "# TYPE httpserver_sent_bytes_total counter\n"
+        "httpserver_sent_bytes_total %lu\n"
+        "# HELP httpserver_shed_connections_total Connections answered with 503 because the "
+        "queue was full.\n"
+        "# TYPE httpserver_shed_connections_total counter\n"
+        "httpserver_shed_connections_total %lu\n",
+        (unsigned long) bytes_in, (unsigned long) bytes_out, (unsigned long) shed);
+
+    text_printf(&t,
+        "# HELP httpserver_lock_attempts_total Attempts to take a resource lock, by mode, "
+        "including ones that timed out.\n"
+        "# TYPE httpserver_lock_attempts_total counter\n");
+    for (int i = 0; i < 2; i++) {
+        text_printf(&t, "httpserver_lock_attempts_total{mode=\"%s\"} %lu\n", modes[i],
+            (unsigned long) lock_attempts[i]);
+    }
+    text_printf(&t,
+        "# HELP httpserver_lock_waits_total Resource lock attempts that had to sleep, by mode.\n"
+        "# TYPE httpserver_lock_waits_total counter\n");
+    for (int i = 0; i < 2; i++) {
+        text_printf(&t, "httpserver_lock_waits_total{mode=\"%s\"} %lu\n", modes[i],
+            (unsigned long) lock_waits[i]);
+    }
+    text_printf(&t,
+        "# HELP httpserver_lock_wait_seconds_total Time spent asleep waiting for resource "
+        "locks, by mode.\n"
+        "# TYPE httpserver_lock_wait_seconds_total counter\n");
+    for (int i = 0; i < 2; i++) {
+        text_printf(&t, "httpserver_lock_wait_seconds_total{mode=\"%s\"} %.9f\n", modes[i],
+            lock_wait_ns[i] / 1e9);
+    }
+
+    text_printf(&t,
+        "# HELP httpserver_lock_waiting_workers Workers waiting for a resource lock right now.\n"
+        "# TYPE httpserver_lock_waiting_workers gauge\n"
+        "httpserver_lock_waiting_workers %lu\n"
+        "# HELP httpserver_busy_workers Workers handling a request right now.\n"
+        "# TYPE httpserver_busy_workers gauge\n"
+        "httpserver_busy_workers %lu\n"
+        "# HELP httpserver_workers Worker threads.\n"
+        "# TYPE httpserver_workers gauge\n"
+        "httpserver_workers %d\n"
+        "# HELP httpserver_queue_depth Connections waiting for a worker.\n"
+        "# TYPE httpserver_queue_depth gauge\n"
+        "httpserver_queue_depth %zu\n",
+        (unsigned long) waiting, (unsigned long) busy, workers, queue_depth);
+
+    text_printf(&t,
+        "# HELP httpserver_queue_operations_total Connections pushed onto and popped off the "
+        "worker queue.\n"
+        "# TYPE httpserver_queue_operations_total counter\n"
+        "httpserver_queue_operations_total{op=\"push\"} %lu\n"
+        "httpserver_queue_operations_total{op=\"pop\"} %lu\n"
+        "# HELP httpserver_queue_waits_total Pops that found the worker queue empty.\n"
+        "# TYPE httpserver_queue_waits_total counter\n"
+        "httpserver_queue_waits_total %lu\n"
+        "# HELP httpserver_queue_wait_seconds_total Time workers spent waiting for a "
+        "connection.\n"
+        "# TYPE httpserver_queue_wait_seconds_total counter\n"
+        "httpserver_queue_wait_seconds_total %.9f\n"
+        "# HELP httpserver_queue_high_water Deepest the worker queue has been right after a "
+        "push.\n"
+        "# TYPE httpserver_queue_high_water gauge\n"
+        "httpserver_queue_high_water %lu\n",
+        (unsigned long) queue_pushes, (unsigned long) queue_pops, (unsigned long) queue_waits,
+        queue_wait_ns / 1e9, (unsigned long) queue_high_water);
+
+    *length = t.length;
+    return t.data;
+}
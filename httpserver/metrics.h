@@ -0,0 +1,139 @@
+/**
+ * @File metrics.h
+ *
+ * Request metrics for the server, exported in the Prometheus text
+ * format.  Every thread that records metrics gets its own block of
+ * counters, which only that thread writes, so recording never touches
+ * a cache line another thread writes.  metrics_render() adds the
+ * blocks up when the metrics are read.
+ *
+ * Every function accepts a NULL metrics_t and then does nothing, so
+ * callers don't need to check whether metrics are enabled.
+ *
+ * @author Ishika Pol
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "queue.h"
+
+/** @struct metrics_t
+ *
+ *  @brief This typedef renames the struct metrics.
+ */
+typedef struct metrics metrics_t;
+
+/** @brief Dynamically allocates and initializes a new set of metrics.
+ *
+ *  @return a pointer to a new metrics_t
+ */
+metrics_t *metrics_new(void);
+
+/** @brief Delete the metrics and free all of their memory.
+ *
+ *  @param m the metrics to be deleted.  *m is set to NULL on return.
+ *  No thread may record metrics at this point.
+ */
+void metrics_delete(metrics_t **m);
+
+/** @brief Note that the calling thread has started on a request.
+ *
+ *  @param m the metrics.
+ *
+ *  @return the start time to pass to metrics_request_end().
+ */
+uint64_t metrics_request_begin(metrics_t *m);
+
+/** @brief Record a request the calling thread has finished.
+ *
+ *  @param m the metrics.
+ *
+ *  @param method the request method, or NULL if it couldn't be parsed.
+ *
+ *  @param status the status code sent in response.
+ *
+ *  @param bytes_in the bytes of the request, headers and body.
+ *
+ *  @param bytes_out the bytes of the response, headers and body.
+ *
+ *  @param start the value metrics_request_begin() returned.
+ */
+void metrics_request_end(metrics_t *m, const char *method, int status, uint64_t bytes_in,
+    uint64_t bytes_out, uint64_t start);
+
+/** @brief Note that the calling thread is about to try for a
+ *         resource's lock.  Reads no clock.
+ *
+ *  @param m the metrics.
+ */
+void metrics_lock_begin(metrics_t *m);
+
+/** @brief Record a lock attempt by the calling thread, whether or not
+ *         it got the lock, and how long it slept.
+ *
+ *  @param m the metrics.
+ *
+ *  @param write whether the lock was taken (or upgraded) for writing.
+ *
+ *  @param waited_ns how long the attempt slept, as timed by the lock's
+ *         slow path (rwlock_last_wait_ns()); 0 if it didn't sleep.
+ */
+void metrics_lock_end(metrics_t *m, bool write, uint64_t waited_ns);
+
+/** @brief Record a connection turned away with 503 because every
+ *         worker was busy and the queue was full.
+ *
+ *  @param m the metrics.
+ */
+void metrics_shed(metrics_t *m);
+
+/** @brief Record connections the calling thread has pushed onto the
+ *         worker queue, and sample the queue's depth for the high-water
+ *         mark.
+ *
+ *  @param m the metrics.
+ *
+ *  @param q the worker queue, read with queue_length().
+ *
+ *  @param n the number of connections pushed.
+ */
+void metrics_queue_push(metrics_t *m, queue_t *q, int n);
+
+/** @brief Start timing a wait for the worker queue.  Call it only once
+ *         a pop has found the queue empty, so pops that don't wait
+ *         read no clock.
+ *
+ *  @param m the metrics.
+ *
+ *  @return the start time to pass to metrics_queue_pop().
+ */
+uint64_t metrics_queue_wait_begin(metrics_t *m);
+
+/** @brief Record a connection the calling thread has popped off the
+ *         worker queue.
+ *
+ *  @param m the metrics.
+ *
+ *  @param wait_start the value metrics_queue_wait_begin() returned if
+ *         the pop had to wait, or 0 if it didn't.
+ */
+void metrics_queue_pop(metrics_t *m, uint64_t wait_start);
+
+/** @brief Render the metrics in the Prometheus text format.
+ *
+ *  @param m the metrics.
+ *
+ *  @param queue_depth the connections waiting for a worker.
+ *
+ *  @param workers the number of worker threads.
+ *
+ *  @param length set to the length of the text.
+ *
+ *  @return the text, which the caller must free().  Counters are
+ *  summed while other threads keep updating them, so related values
+ *  may be a few requests apart.
+ */
+char *metrics_render(metrics_t *m, size_t queue_depth, int workers, size_t *length);
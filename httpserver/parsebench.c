@@ -0,0 +1,369 @@
+// Main File - parsebench.c
+// Ishika Pol - CSE130
+// Micro-benchmark comparing request_parse() against the POSIX regex parsing it replaced.
+// Before timing anything it runs both parsers over a corpus of valid and randomly mutated
+// requests and checks that they agree, so the numbers compare parsers with the same rules.
+
+#include <limits.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include "request.h"
+
+#define MAX_REQUEST_BUFFER_SIZE 2048
+#define DEFAULT_CORPUS_SIZE 20000
+#define DEFAULT_ROUNDS 10
+// Compiling the regexes takes about a millisecond, so that variant is only timed on this many
+// requests per round
+#define REGCOMP_SAMPLE 1000
+
+// The patterns handle_request() used to compile for every request, anchored to the line start
+#define REQUEST_LINE_PATTERN "^([A-Z]{1,8}) /([A-Za-z0-9.]{2,64}) (HTTP/[0-9].[0-9])\r\n"
+#define HEADER_LINE_PATTERN "^([A-Za-z0-9.-]{1,128}): ([ -~]{0,128})\r\n"
+
+// One request in the corpus
+typedef struct sample {
+    int length;
+    char bytes[MAX_REQUEST_BUFFER_SIZE + 1];
+} sample_t;
+
+// What a parser made of a request, for comparing the two implementations
+typedef struct outcome {
+    int status;
+    char method[16];
+    char uri[80];
+    int content_length;
+    int keep_alive;
+    long body_offset;
+} outcome_t;
+
+// Copy a regex match out of buffer into dst
+void copy_match(char *dst, size_t size, const char *buffer, regmatch_t match) {
+    size_t length = match.rm_eo - match.rm_so;
+
+    if (length >= size) {
+        length = size - 1;
+    }
+    memcpy(dst, buffer + match.rm_so, length);
+    dst[length] = '\0';
+}
+
+// Parse a request with already compiled request-line and header regexes
+int regex_parse_with(char *buffer, regex_t *request_regex, regex_t *header_regex, outcome_t *out) {
+    regmatch_t matches[4];
+    char *headers;
+    char key[160], value[160], version[16];
+    long content_length;
+
+    memset(out, 0, sizeof(*out));
+    out->keep_alive = 1;
+
+    if (regexec(request_regex, buffer, 4, matches, 0) != 0) {
+        return out->status = 400;
+    }
+    copy_match(out->method, sizeof(out->method), buffer, matches[1]);
+    copy_match(out->uri, sizeof(out->uri), buffer, matches[2]);
+    copy_match(version, sizeof(version), buffer, matches[3]);
+    if (strcmp(version, "HTTP/1.1") != 0) {
+        return out->status = 505;
+    }
+
+    headers = buffer + matches[0].rm_eo;
+    while (headers[0] != '\r' || headers[1] != '\n') {
+        if (regexec(header_regex, headers, 3, matches, 0) != 0) {
+            return out->status = 400;
+        }
+        copy_match(key, sizeof(key), headers, matches[1]);
+        copy_match(value, sizeof(value), headers, matches[2]);
+
+        if (strcmp(key, "Content-Length") == 0) {
+            content_length = strtol(value, NULL, 10);
+            if (content_length <= 0 || content_length > INT_MAX) {
+                return out->status = 400;
+            }
+            out->content_length = (int) content_length;
+        } else if (strcasecmp(key, "Connection") == 0 && strcasecmp(value, "close") == 0) {
+            out->keep_alive = 0;
+        }
+        headers += matches[0].rm_eo;
+    }
+
+    out->body_offset = headers + 2 - buffer;
+    return out->status = 0;
+}
+
+// Parse a request the way handle_request() used to: compile both regexes, match, free them
+int regex_parse(char *buffer, outcome_t *out) {
+    regex_t request_regex, header_regex;
+    int status;
+
+    regcomp(&request_regex, REQUEST_LINE_PATTERN, REG_EXTENDED);
+    regcomp(&header_regex, HEADER_LINE_PATTERN, REG_EXTENDED);
+    status = regex_parse_with(buffer, &request_regex, &header_regex, out);
+    regfree(&request_regex);
+    regfree(&header_regex);
+
+    return status;
+}
+
+// Parse a request with request_parse() and record the result in the same form
+int parser_parse(char *buffer, outcome_t *out) {
+    request_t request;
+
+    memset(out, 0, sizeof(*out));
+    out->keep_alive = 1;
+    out->status = request_parse(buffer, &request);
+    if (request.method != NULL) {
+        snprintf(out->method, sizeof(out->method), "%s", request.method);
+    }
+    if (request.uri != NULL) {
+        snprintf(out->uri, sizeof(out->uri), "%s", request.uri);
+    }
+    if (out->status == 0) {
+        out->content_length = request.content_length;
+        out->keep_alive = request.keep_alive;
+        out->body_offset = request.body - buffer;
+    }
+
+    return out->status;
+}
+
+// Whether two outcomes agree on everything the server uses
+int same_outcome(outcome_t *a, outcome_t *b) {
+    if (a->status != b->status) {
+        return 0;
+    }
+    if (a->status == 400) {
+        return 1;
+    }
+    if (strcmp(a->method, b->method) != 0 || strcmp(a->uri, b->uri) != 0) {
+        return 0;
+    }
+    return a->status != 0
+           || (a->content_length == b->content_length && a->keep_alive == b->keep_alive
+               && a->body_offset == b->body_offset);
+}
+
+// Append a random string of length characters drawn from chars
+void append_random(char *buffer, int *length, const char *chars, int count) {
+    int nchars = strlen(chars);
+
+    for (int i = 0; i < count && *length < MAX_REQUEST_BUFFER_SIZE; i++) {
+        buffer[(*length)++] = chars[rand() % nchars];
+    }
+    buffer[*length] = '\0';
+}
+
+// Append a NUL-terminated string, as much of it as fits
+void append(char *buffer, int *length, const char *text) {
+    while (*text != '\0' && *length < MAX_REQUEST_BUFFER_SIZE) {
+        buffer[(*length)++] = *text++;
+    }
+    buffer[*length] = '\0';
+}
+
+// Build a request. Strict requests only use valid pieces; loose ones also pick lengths and
+// values just past the parser's limits.
+void generate_request(sample_t *sample, int strict) {
+    static const char *methods[] = { "GET", "PUT", "HEAD", "DELETE", "ABCDEFGH", "ABCDEFGHI",
+        "get", "" };
+    static const char *versions[] = { "HTTP/1.1", "HTTP/1.1", "HTTP/1.1", "HTTP/1.0", "HTTP/2x0",
+        "HTTP/1.", "HTTP/11.1", "http/1.1" };
+    static const char *keys[] = { "Content-Length", "Connection", "Host", "User-Agent",
+        "content-length", "X-Request-Id", "Accept" };
+    static const char *values[] = { "5", "0", "-3", "12abc", " 42", "99999999999", "close",
+        "CLOSE", "keep-alive", "localhost:8080", "curl/8.0", "*/*" };
+    const char *uri_chars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789.";
+    const char *key_chars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789.-";
+    char number[16];
+    int headers = rand() % 6;
+    int choices = strict ? 3 : 8;
+
+    sample->length = 0;
+    append(sample->bytes, &sample->length, methods[rand() % choices]);
+    append(sample->bytes, &sample->length, " /");
+    append_random(
+        sample->bytes, &sample->length, uri_chars, strict ? 2 + rand() % 63 : 1 + rand() % 66);
+    append(sample->bytes, &sample->length, " ");
+    append(sample->bytes, &sample->length, versions[rand() % choices]);
+    append(sample->bytes, &sample->length, "\r\n");
+
+    for (int i = 0; i < headers; i++) {
+        if (rand() % 4 == 0) {
+            append_random(sample->bytes, &sample->length, key_chars,
+                strict ? 1 + rand() % 128 : 1 + rand() % 130);
+        } else {
+            append(sample->bytes, &sample->length, keys[rand() % 7]);
+        }
+        append(sample->bytes, &sample->length, ": ");
+        if (rand() % 4 == 0) {
+            // Printable ASCII values, sometimes longer than the 128 character limit
+            for (int j = strict ? rand() % 129 : rand() % 131; j > 0; j--) {
+                number[0] = (char) (' ' + rand() % 95);
+                number[1] = '\0';
+                append(sample->bytes, &sample->length, number);
+            }
+        } else if (rand() % 3 == 0) {
+            snprintf(number, sizeof(number), "%d", 1 + rand() % 2000);
+            append(sample->bytes, &sample->length, number);
+        } else {
+            append(
+                sample->bytes, &sample->length, values[strict ? 6 + rand() % 6 : rand() % 12]);
+        }
+        append(sample->bytes, &sample->length, "\r\n");
+    }
+    append(sample->bytes, &sample->length, "\r\n");
+
+    // Sometimes a body, or the start of a pipelined request, follows the headers
+    if (rand() % 2 == 0) {
+        append(sample->bytes, &sample->length, "hello GET /next HTTP/1.1\r\n\r\n");
+    }
+}
+
+// Damage a request with a few random edits: overwrites, deletions and separator insertions
+void mutate_request(sample_t *sample) {
+    static const char *inserts[] = { "\r\n", " ", ":", "/", "\r", "\n", "\x7f", "\t" };
+    int edits = 1 + rand() % 3;
+    int position, length;
+    const char *insert;
+
+    for (int i = 0; i < edits && sample->length > 0; i++) {
+        position = rand() % sample->length;
+        switch (rand() % 3) {
+        case 0: sample->bytes[position] = (char) (1 + rand() % 255); break;
+        case 1:
+            memmove(sample->bytes + position, sample->bytes + position + 1,
+                sample->length - position);
+            sample->length--;
+            break;
+        default:
+            insert = inserts[rand() % 8];
+            length = strlen(insert);
+            if (sample->length + length <= MAX_REQUEST_BUFFER_SIZE) {
+                memmove(sample->bytes + position + length, sample->bytes + position,
+                    sample->length - position + 1);
+                memcpy(sample->bytes + position, insert, length);
+                sample->length += length;
+            }
+            break;
+        }
+    }
+    sample->bytes[sample->length] = '\0';
+}
+
+// Nanoseconds on the monotonic clock
+double now_ns(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+    int corpus_size = DEFAULT_CORPUS_SIZE;
+    int rounds = DEFAULT_ROUNDS;
+    unsigned seed = (unsigned) time(NULL);
+    int opt, mismatches = 0, accepted = 0;
+    sample_t *corpus;
+    regex_t request_regex, header_regex;
+    outcome_t expected, actual;
+    char scratch[MAX_REQUEST_BUFFER_SIZE + 1];
+    double start, regex_ns, precompiled_ns, parser_ns;
+    int regcomp_sample;
+
+    while ((opt = getopt(argc, argv, "n:r:s:")) != -1) {
+        switch (opt) {
+        case 'n': corpus_size = atoi(optarg); break;
+        case 'r': rounds = atoi(optarg); break;
+        case 's': seed = (unsigned) strtoul(optarg, NULL, 10); break;
+        default:
+            fprintf(stderr, "usage: %s [-n requests] [-r rounds] [-s seed]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (corpus_size < 1 || rounds < 1) {
+        fprintf(stderr, "Invalid corpus size or round count\n");
+        exit(1);
+    }
+
+    // Build the corpus: a third strict requests, a third loose ones, and a third strict
+    // requests with random edits
+    srand(seed);
+    corpus = (sample_t *) malloc(sizeof(sample_t) * corpus_size);
+    if (corpus == NULL) {
+        fprintf(stderr, "Failed to allocate corpus\n");
+        exit(1);
+    }
+    for (int i = 0; i < corpus_size; i++) {
+        generate_request(&corpus[i], i % 3 != 1);
+        if (i % 3 == 2) {
+            mutate_request(&corpus[i]);
+        }
+    }
+
+    regcomp(&request_regex, REQUEST_LINE_PATTERN, REG_EXTENDED);
+    regcomp(&header_regex, HEADER_LINE_PATTERN, REG_EXTENDED);
+
+    // Both parsers write into the buffer, so each gets a fresh copy of every request
+    for (int i = 0; i < corpus_size; i++) {
+        memcpy(scratch, corpus[i].bytes, corpus[i].length + 1);
+        regex_parse_with(scratch, &request_regex, &header_regex, &expected);
+        memcpy(scratch, corpus[i].bytes, corpus[i].length + 1);
+        parser_parse(scratch, &actual);
+
+        accepted += expected.status == 0;
+        if (!same_outcome(&expected, &actual)) {
+            if (mismatches++ < 10) {
+                printf("mismatch: regex %d, parser %d on \"%.*s\"\n", expected.status,
+                    actual.status, corpus[i].length, corpus[i].bytes);
+            }
+        }
+    }
+    printf("seed %u: %d requests, %d accepted, %d mismatches\n", seed, corpus_size, accepted,
+        mismatches);
+
+    // Time the three ways of parsing over the corpus
+    regcomp_sample = corpus_size < REGCOMP_SAMPLE ? corpus_size : REGCOMP_SAMPLE;
+    start = now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < regcomp_sample; i++) {
+            memcpy(scratch, corpus[i].bytes, corpus[i].length + 1);
+            regex_parse(scratch, &expected);
+        }
+    }
+    regex_ns = (now_ns() - start) / ((double) rounds * regcomp_sample);
+
+    start = now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < corpus_size; i++) {
+            memcpy(scratch, corpus[i].bytes, corpus[i].length + 1);
+            regex_parse_with(scratch, &request_regex, &header_regex, &expected);
+        }
+    }
+    precompiled_ns = (now_ns() - start) / ((double) rounds * corpus_size);
+
+    start = now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < corpus_size; i++) {
+            memcpy(scratch, corpus[i].bytes, corpus[i].length + 1);
+            parser_parse(scratch, &actual);
+        }
+    }
+    parser_ns = (now_ns() - start) / ((double) rounds * corpus_size);
+
+    printf("regcomp+regexec per request: %10.1f ns/request\n", regex_ns);
+    printf("precompiled regexec:         %10.1f ns/request\n", precompiled_ns);
+    printf("request_parse:               %10.1f ns/request (%.1fx faster than per-request "
+           "regcomp, %.1fx faster than precompiled)\n",
+        parser_ns, regex_ns / parser_ns, precompiled_ns / parser_ns);
+
+    regfree(&request_regex);
+    regfree(&header_regex);
+    free(corpus);
+
+    return mismatches != 0;
+}
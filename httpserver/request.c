@@ -0,0 +1,246 @@
+// Main File - request.c
+// Ishika Pol - CSE130
+// Hand-written, single-pass parser for HTTP request lines and headers.
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "request.h"
+
+#define MAX_METHOD_LENGTH 8
+#define MIN_URI_LENGTH 2
+#define MAX_URI_LENGTH 64
+#define MAX_KEY_LENGTH 128
+#define MAX_VALUE_LENGTH 128
+// Digits allowed in a range position, so it can't overflow a long
+#define MAX_RANGE_DIGITS 18
+
+// Character classes from the original patterns; spelled out so the locale can't change them
+static int is_method_char(char c) {
+    return c >= 'A' && c <= 'Z';
+}
+
+static int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static int is_uri_char(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || is_digit(c) || c == '.';
+}
+
+static int is_key_char(char c) {
+    return is_uri_char(c) || c == '-';
+}
+
+static int is_value_char(char c) {
+    return c >= ' ' && c <= '~';
+}
+
+// Parse a run of decimal digits into *value; returns a pointer past them, or NULL if there
+// are none or too many
+static char *parse_position(char *p, long *value) {
+    char *start = p;
+
+    *value = 0;
+    while (is_digit(*p)) {
+        // Give up before the digit that would make the value too long to fit in a long
+        if (p - start == MAX_RANGE_DIGITS) {
+            return NULL;
+        }
+        *value = *value * 10 + (*p - '0');
+        p++;
+    }
+    return p == start ? NULL : p;
+}
+
+// Parse "bytes=first-last", "bytes=first-" or "bytes=-n". Anything else, including a list
+// of ranges, leaves has_range at 0 so the whole file is sent, as HTTP allows.
+static void parse_range(char *value, request_t *request) {
+    char *p = value;
+    long first = -1, last = -1;
+
+    if (strncasecmp(p, "bytes=", 6) != 0) {
+        return;
+    }
+    p += 6;
+
+    if (*p != '-') {
+        p = parse_position(p, &first);
+        if (p == NULL || *p != '-') {
+            return;
+        }
+    }
+    p++;
+    if (*p != '\0') {
+        p = parse_position(p, &last);
+        if (p == NULL || *p != '\0') {
+            return;
+        }
+    } else if (first == -1) {
+        // "bytes=-" names no bytes at all
+        return;
+    }
+    if (first != -1 && last != -1 && last < first) {
+        return;
+    }
+
+    request->has_range = 1;
+    request->range_first = first;
+    request->range_last = last;
+}
+
+// Act on the headers the server cares about; returns 0, or 400 for a bad Content-Length
+static int handle_header(char *key, char *value, request_t *request) {
+    long content_length;
+
+    // Check if the key is "Content-Length"
+    if (strcmp(key, "Content-Length") == 0) {
+        // Content length must be greater than 0 and fit in an int
+        content_length = strtol(value, NULL, 10);
+        if (content_length <= 0 || content_length > INT_MAX) {
+            return 400;
+        }
+        request->content_length = (int) content_length;
+    }
+    // The client asks for the connection to be closed after this request
+    else if (strcasecmp(key, "Connection") == 0 && strcasecmp(value, "close") == 0) {
+        request->keep_alive = 0;
+    }
+    // Only the first Range is honoured; a repeated header would be a list of ranges anyway
+    else if (strcasecmp(key, "Range") == 0 && !request->has_range) {
+        parse_range(value, request);
+    }
+    // Validators for a conditional GET, checked once the file has been found
+    else if (strcasecmp(key, "If-None-Match") == 0) {
+        request->if_none_match = value;
+    } else if (strcasecmp(key, "If-Modified-Since") == 0) {
+        request->if_modified_since = value;
+    } else if (strcasecmp(key, "Request-Id") == 0) {
+        request->request_id = value;
+    }
+
+    return 0;
+}
+
+// Parse the request line and headers at the start of buffer
+int request_parse(char *buffer, request_t *request) {
+    char *p = buffer;
+    char *start, *key;
+    int status;
+
+    request->method = NULL;
+    request->uri = NULL;
+    request->version = NULL;
+    request->content_length = 0;
+    request->keep_alive = 1;
+    request->has_range = 0;
+    request->range_first = -1;
+    request->range_last = -1;
+    request->if_none_match = NULL;
+    request->if_modified_since = NULL;
+    request->request_id = NULL;
+    request->body = NULL;
+
+    // Method: 1 to 8 uppercase letters followed by a space
+    start = p;
+    while (is_method_char(*p)) {
+        p++;
+    }
+    if (p - start < 1 || p - start > MAX_METHOD_LENGTH || *p != ' ') {
+        return 400;
+    }
+    *p++ = '\0';
+    request->method = start;
+
+    // URI: '/' then 2 to 64 letters, digits or dots, followed by a space
+    if (*p != '/') {
+        return 400;
+    }
+    start = ++p;
+    while (is_uri_char(*p)) {
+        p++;
+    }
+    if (p - start < MIN_URI_LENGTH || p - start > MAX_URI_LENGTH || *p != ' ') {
+        return 400;
+    }
+    *p++ = '\0';
+    request->uri = start;
+
+    // Version: "HTTP/", a digit, any character, a digit, then CRLF
+    if (strncmp(p, "HTTP/", 5) != 0 || !is_digit(p[5]) || p[6] == '\0' || !is_digit(p[7])
+        || p[8] != '\r' || p[9] != '\n') {
+        return 400;
+    }
+    p[8] = '\0';
+    request->version = p;
+    p += 10;
+
+    // Check if the HTTP version is not HTTP/1.1
+    if (strcmp(request->version, "HTTP/1.1") != 0) {
+        return 505;
+    }
+
+    // Headers: "key: value" lines until the empty line
+    while (p[0] != '\r' || p[1] != '\n') {
+        start = p;
+        while (is_key_char(*p)) {
+            p++;
+        }
+        if (p - start < 1 || p - start > MAX_KEY_LENGTH || p[0] != ':' || p[1] != ' ') {
+            return 400;
+        }
+        *p = '\0';
+        key = start;
+        p += 2;
+
+        start = p;
+        while (is_value_char(*p)) {
+            p++;
+        }
+        if (p - start > MAX_VALUE_LENGTH || p[0] != '\r' || p[1] != '\n') {
+            return 400;
+        }
+        *p = '\0';
+        p += 2;
+
+        status = handle_header(key, start, request);
+        if (status != 0) {
+            return status;
+        }
+    }
+
+    request->body = p + 2;
+    return 0;
+}
+
+// Clip the requested range to a file of the given size
+int request_range(const request_t *request, off_t size, off_t *offset, size_t *count) {
+    off_t first, last;
+
+    *offset = 0;
+    *count = (size_t) size;
+    if (!request->has_range) {
+        return 200;
+    }
+
+    if (request->range_first == -1) {
+        // A suffix range wants the last range_last bytes, or the whole file if it is shorter
+        if (request->range_last == 0 || size == 0) {
+            return 416;
+        }
+        first = request->range_last < size ? size - request->range_last : 0;
+        last = size - 1;
+    } else {
+        if (request->range_first >= size) {
+            return 416;
+        }
+        first = request->range_first;
+        last = request->range_last == -1 || request->range_last >= size ? size - 1
+                                                                         : request->range_last;
+    }
+
+    *offset = first;
+    *count = (size_t) (last - first + 1);
+    return 206;
+}
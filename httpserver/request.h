@@ -0,0 +1,72 @@
+/**
+ * @File request.h
+ *
+ * Single-pass parser for the request line and headers of an HTTP
+ * request.  It accepts exactly what the server's original regular
+ * expressions accepted, matched from the start of each line:
+ *
+ *   request line: ([A-Z]{1,8}) /([A-Za-z0-9.]{2,64}) (HTTP/[0-9].[0-9])\r\n
+ *   header line:  ([A-Za-z0-9.-]{1,128}): ([ -~]{0,128})\r\n
+ *
+ * followed by an empty line.
+ *
+ * @author Ishika Pol
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/** @struct request_t
+ *
+ *  @brief The parts of a request the server acts on.  All pointers
+ *  point into the buffer that was parsed.
+ */
+typedef struct request {
+    char *method; // NUL-terminated method, e.g. "GET"
+    char *uri; // NUL-terminated URI without the leading '/'
+    char *version; // NUL-terminated version, always "HTTP/1.1" on success
+    int content_length; // Value of the Content-Length header, 0 if absent
+    int keep_alive; // 0 if the client sent "Connection: close", 1 otherwise
+    int has_range; // 1 if the client sent a single "Range: bytes=first-last", 0 otherwise
+    long range_first; // First byte wanted, or -1 for the last range_last bytes ("bytes=-n")
+    long range_last; // Last byte wanted, or -1 for the rest of the file ("bytes=first-")
+    char *if_none_match; // NUL-terminated If-None-Match value, NULL if absent
+    char *if_modified_since; // NUL-terminated If-Modified-Since value, NULL if absent
+    char *request_id; // NUL-terminated Request-Id value for the audit log, NULL if absent
+    char *body; // First byte after the blank line that ends the headers
+} request_t;
+
+/** @brief Parse the request line and headers at the start of buffer.
+ *         The buffer is modified in place: the method, URI, version,
+ *         and header keys and values are NUL-terminated.
+ *
+ *  @param buffer the request bytes, NUL-terminated after the last
+ *         byte received.
+ *
+ *  @param request filled in with the parsed request on success.
+ *
+ *  @return 0 on success, 505 if the request is well formed but not
+ *          HTTP/1.1, or 400 if it is malformed (including a
+ *          Content-Length that is not a positive number).  A Range
+ *          header the server can't serve (another unit, several
+ *          ranges, or bad syntax) is ignored rather than rejected.
+ */
+int request_parse(char *buffer, request_t *request);
+
+/** @brief Work out which bytes of a file a parsed Range asks for.
+ *
+ *  @param request a request parsed by request_parse().
+ *
+ *  @param size the size of the file in bytes.
+ *
+ *  @param offset set to the first byte to send.
+ *
+ *  @param count set to the number of bytes to send.
+ *
+ *  @return 200 if the request has no range (the whole file is set),
+ *          206 if the range overlaps the file (clipped to its end), or
+ *          416 if it starts past the end of the file.
+ */
+int request_range(const request_t *request, off_t size, off_t *offset, size_t *count);